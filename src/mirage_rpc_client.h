@@ -13,6 +13,10 @@
 #include <spdlog/spdlog.h>
 #include "zmq.hpp"
 #include "grpcpp/grpcpp.h"
+#include "mirage_rpc_trace.h"
+#include "mirage_rpc_tuning.h"
+#include "mirage_rpc_runtime.h"
+#include "mirage_rpc_local.h"
 
 /**
  * @file mirage_rpc_client.h
@@ -34,7 +38,7 @@
 struct mirage_rpc_client_config {
     // --- 核心地址配置 ---
     std::string grpc_addr; ///< gRPC 服务器地址，格式为 "ip:port"。
-    std::string zmq_addr;  ///< ZMQ 服务器地址，格式可以为 "tcp://ip:port" 或 "ipc:///path/to/socket"。
+    std::string zmq_addr;  ///< ZMQ 服务器地址，格式可以为 "tcp://ip:port"、"ipc:///path/to/socket" 或 "inproc://name"。
 
     // --- ZMQ 特定配置 ---
     zmq::socket_type zmq_socket_type = zmq::socket_type::sub; ///< ZMQ socket 类型，默认为 SUB (订阅)。
@@ -42,11 +46,20 @@ struct mirage_rpc_client_config {
     int zmq_io_threads = 1;         ///< ZMQ I/O 线程数。
     int zmq_linger_ms = 1000;       ///< socket 关闭前的等待时间(毫秒)，确保挂起的消息已发送。
     int zmq_rcv_timeout_ms = 1000;  ///< ZMQ 接收操作的超时时间(毫秒)。
+    mirage_rpc_zmq_tuning zmq_tuning; ///< socket 与上下文调优 (缓冲区、keepalive、分方向高水位线等)，见 mirage_rpc_tuning.h。
+    std::shared_ptr<mirage_rpc_runtime> zmq_runtime; ///< 可选的共享运行时；设置后使用其上下文和 I/O 线程，zmq_io_threads 与上下文级调优被忽略。
 
     // --- gRPC 特定配置 ---
     size_t grpc_max_receive_message_size = 1024 * 1024 * 4; ///< gRPC 允许接收的最大消息大小 (默认 4MB)。
     size_t grpc_max_send_message_size = 1024 * 1024 * 4;    ///< gRPC 允许发送的最大消息大小 (默认 4MB)。
     int grpc_timeout_ms = 30000; ///< gRPC 连接超时时间 (默认 30秒)。
+    bool grpc_prefer_in_process = false; ///< 地址匹配本进程内已启动的服务器时，是否使用进程内 channel (不跟随服务器重启，见 open_in_process_channel)。
+
+    // --- 追踪配置 (见 mirage_rpc_trace.h) ---
+    bool enable_trace = false;          ///< 是否启用端到端延迟追踪，服务器需同时启用。
+    bool trace_zmq_trailer = false;     ///< 是否解析服务器追加在被采样 ZMQ 消息之后的追踪头帧 (线上协议变化，需与服务器一致)。
+    uint32_t trace_sample_every = 100;  ///< gRPC 调用的采样间隔，ZMQ 消息的采样由服务器决定。
+    std::string trace_export_path;      ///< 追踪文件输出路径 (Chrome trace 格式)，为空则不导出。
 
     // --- 便捷设置函数 (Convenience Setters) ---
 
@@ -73,6 +86,17 @@ struct mirage_rpc_client_config {
         zmq_addr = "ipc:///tmp/" + name + ".sock";
     }
 
+    /**
+     * @brief 设置 ZMQ 的进程内 (inproc) 地址，需与同一进程内服务器的名称一致。
+     * @param name inproc 端点的唯一名称。
+     */
+    void set_zmq_inproc_addr(const std::string& name) {
+        if (name.empty()) {
+            throw std::invalid_argument("inproc 名称不能为空");
+        }
+        zmq_addr = "inproc://" + name;
+    }
+
     /**
      * @brief 设置 ZMQ 的 TCP 地址。
      * @param ip IP 地址。
@@ -104,6 +128,8 @@ public:
     }
 
     // --- 资源管理：禁止拷贝，允许移动 ---
+    // 接收线程与共享运行时的回调捕获了对象地址，无法随对象转移：移动时先断开两端，只转移配置，
+    // 移动后的对象处于断开状态，需要重新 connect。
     mirage_rpc_client(const mirage_rpc_client&) = delete;
     mirage_rpc_client& operator=(const mirage_rpc_client&) = delete;
 
@@ -114,6 +140,7 @@ public:
     mirage_rpc_client& operator=(mirage_rpc_client&& other) noexcept {
         if (this != &other) {
             disconnect(); // 先释放当前对象的资源
+            other.disconnect(); // 被移动的客户端可能仍处于连接状态，其接收线程会继续读取 config_
             config_ = std::move(other.config_);
             // 其他成员（如 channel, socket）在 `connect` 时创建，无需移动
         }
@@ -124,7 +151,8 @@ public:
 
     /**
      * @brief 连接到 RPC 服务器。
-     * @details 根据提供的配置，初始化并连接 gRPC 和 ZMQ。会启动一个后台线程处理 ZMQ 消息。
+     * @details 根据提供的配置，初始化并连接 gRPC 和 ZMQ。会启动一个后台线程处理 ZMQ 消息；
+     * 如果配置了 `zmq_runtime`，则改为挂载到共享运行时的 I/O 线程上。
      * @param config 客户端配置对象。
      * @throws std::runtime_error 如果连接失败或配置无效。
      * @example
@@ -149,17 +177,31 @@ public:
             config_ = config;
             validate_config();
 
+            // inproc 要求两端共享上下文，没有显式配置运行时时使用进程级的默认运行时
+            if (mirage_rpc_is_inproc(config_.zmq_addr) && !config_.zmq_runtime) {
+                config_.zmq_runtime = mirage_rpc_runtime::shared_instance();
+            }
+
+            if (config_.enable_trace && !config_.trace_export_path.empty()) {
+                mirage_rpc_tracer::instance().start_export(config_.trace_export_path);
+            }
+
             // 1. 建立 gRPC 连接
             setup_grpc_channel();
 
-            // 2. 启动 ZMQ 后台线程
-            zmq_thread_ = std::thread(&mirage_rpc_client::start_zmq, this);
+            // 2. 挂载到共享运行时，或启动 ZMQ 后台线程
+            if (config_.zmq_runtime) {
+                attach_zmq_runtime();
+            } else {
+                zmq_thread_ = std::thread(&mirage_rpc_client::start_zmq, this);
+            }
 
             connected_.store(true);
             spdlog::info("RPC 客户端连接成功 - gRPC: {}, ZMQ: {}", config_.grpc_addr, config_.zmq_addr);
 
         } catch (const std::exception& e) {
             spdlog::error("连接服务器失败: {}", e.what());
+            detach_zmq_runtime();
             cleanup_resources(); // 出错时清理已分配的资源
             throw;
         }
@@ -182,6 +224,7 @@ public:
         if (zmq_thread_.joinable()) {
             zmq_thread_.join(); // 等待 ZMQ 线程完全结束
         }
+        detach_zmq_runtime();
 
         cleanup_resources();
         spdlog::info("RPC 客户端已断开连接");
@@ -223,40 +266,42 @@ public:
 
     /**
      * @brief 发送 ZMQ 消息（仅限可发送的 socket 类型）。
-     * @details 支持的 socket 类型包括 PUB, PUSH, REQ。
+     * @details 支持的 socket 类型包括 PUB, PUSH, REQ。达到高水位线时阻塞，直到消息被 ZMQ 接受。
+     * 挂载到共享运行时时，每条消息同步转交给共享的 I/O 线程以非阻塞方式发送 (一次跨线程往返)，
+     * 发送缓冲区已满时在调用线程中退避重试，不会阻塞 I/O 线程；在消息处理函数 (即 I/O 线程) 中应使用 `zmq_try_send`。
      * @param data 指向待发送数据的指针。
      * @param size 数据的大小（字节）。
-     * @throws std::runtime_error 如果客户端未连接或 socket 类型不支持发送。
+     * @throws std::runtime_error 如果客户端未连接 (或在等待期间断开) 或 socket 类型不支持发送。
      * @throws std::invalid_argument 如果 data 为空或 size 为 0。
      */
     void zmq_send(const void* data, size_t size) {
-        if (!data || size == 0) {
-            throw std::invalid_argument("无效的消息数据");
-        }
-        if (!connected_.load()) {
-            throw std::runtime_error("客户端未连接，无法发送 ZMQ 消息");
-        }
-
-        // 检查 socket 类型是否支持发送操作
-        if (config_.zmq_socket_type != zmq::socket_type::pub &&
-            config_.zmq_socket_type != zmq::socket_type::push &&
-            config_.zmq_socket_type != zmq::socket_type::req) {
-            throw std::runtime_error("当前的 ZMQ socket 类型不支持发送消息");
+        check_sendable(data, size);
+        if (!config_.zmq_runtime) {
+            send_once(data, size, zmq::send_flags::none);
+            return;
         }
 
-        try {
-            std::lock_guard<std::mutex> lock(socket_mutex_);
-            if (socket_) {
-                zmq::message_t message(size);
-                std::memcpy(message.data(), data, size);
-                socket_->send(message, zmq::send_flags::none);
+        auto backoff = std::chrono::microseconds(50);
+        while (!send_once(data, size, zmq::send_flags::dontwait)) {
+            if (!connected_.load()) {
+                throw std::runtime_error("客户端已断开，ZMQ 消息未发送");
             }
-        } catch (const zmq::error_t& e) {
-            spdlog::error("发送 ZMQ 消息失败: {}", e.what());
-            throw std::runtime_error("发送 ZMQ 消息失败: " + std::string(e.what()));
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::microseconds(5000));
         }
     }
 
+    /**
+     * @brief 以非阻塞方式发送 ZMQ 消息。
+     * @returns 如果达到高水位线 (发送缓冲区已满)，则返回 false，消息未被发送。
+     * @throws std::runtime_error 如果客户端未连接或 socket 类型不支持发送。
+     * @throws std::invalid_argument 如果 data 为空或 size 为 0。
+     */
+    bool zmq_try_send(const void* data, size_t size) {
+        check_sendable(data, size);
+        return send_once(data, size, zmq::send_flags::dontwait);
+    }
+
     /**
      * @brief 发送字符串作为 ZMQ 消息。
      * @param message 要发送的字符串。
@@ -274,16 +319,15 @@ public:
         if (config_.zmq_socket_type != zmq::socket_type::sub) {
             throw std::runtime_error("只有 SUB socket 支持订阅主题");
         }
-        std::lock_guard<std::mutex> lock(socket_mutex_);
-        if (socket_) {
+        with_socket([&](zmq::socket_t& socket) {
             try {
-                socket_->set(zmq::sockopt::subscribe, topic);
+                socket.set(zmq::sockopt::subscribe, topic);
                 spdlog::info("已订阅 ZMQ 主题: {}", topic.empty() ? "(所有)" : topic);
             } catch (const zmq::error_t& e) {
                 spdlog::error("订阅 ZMQ 主题 '{}' 失败: {}", topic, e.what());
                 throw;
             }
-        }
+        });
     }
 
     /**
@@ -295,16 +339,15 @@ public:
         if (config_.zmq_socket_type != zmq::socket_type::sub) {
             throw std::runtime_error("只有 SUB socket 支持取消订阅主题");
         }
-        std::lock_guard<std::mutex> lock(socket_mutex_);
-        if (socket_) {
+        with_socket([&](zmq::socket_t& socket) {
             try {
-                socket_->set(zmq::sockopt::unsubscribe, topic);
+                socket.set(zmq::sockopt::unsubscribe, topic);
                 spdlog::info("已取消订阅 ZMQ 主题: {}", topic);
             } catch (const zmq::error_t& e) {
                 spdlog::error("取消订阅 ZMQ 主题 '{}' 失败: {}", topic, e.what());
                 throw;
             }
-        }
+        });
     }
 
     // --- 状态检查 (State Checkers) ---
@@ -328,6 +371,31 @@ private:
         if (config_.zmq_addr.empty()) {
             throw std::invalid_argument("ZMQ 地址不能为空");
         }
+        config_.zmq_tuning.validate();
+    }
+
+    /** @brief 创建追踪拦截器列表，本客户端的 gRPC 调用共享一个采样计数。*/
+    std::vector<std::unique_ptr<grpc::experimental::ClientInterceptorFactoryInterface>> trace_interceptors() const {
+        std::vector<std::unique_ptr<grpc::experimental::ClientInterceptorFactoryInterface>> interceptors;
+        interceptors.push_back(std::make_unique<mirage_rpc_trace_client_interceptor_factory>(
+            std::make_shared<mirage_rpc_trace_sampler>(config_.trace_sample_every)));
+        return interceptors;
+    }
+
+    /**
+     * @brief 如果地址匹配本进程内的服务器，则创建进程内 channel。
+     * @details 进程内 channel 绑定到连接时匹配的那一个 `grpc::Server`，不会像网络 channel 那样重连。
+     * gRPC 在服务器关闭后通过它发起调用会崩溃，因此服务器停止时会等待 channel 及其存根全部释放再关闭：
+     * 应在停止服务器之前 `disconnect` (并释放存根)，服务器重新启动后再 `connect`。
+     * @returns 没有匹配的服务器时返回 nullptr。
+     */
+    std::shared_ptr<grpc::Channel> open_in_process_channel(const grpc::ChannelArguments& args) {
+        return mirage_rpc_local_registry::instance().open_channel(config_.grpc_addr, [&](grpc::Server& server) {
+            if (config_.enable_trace) {
+                return server.experimental().InProcessChannelWithInterceptors(args, trace_interceptors());
+            }
+            return server.InProcessChannel(args);
+        });
     }
 
     /** @brief 初始化并建立 gRPC 连接。*/
@@ -336,11 +404,28 @@ private:
         args.SetMaxReceiveMessageSize(config_.grpc_max_receive_message_size);
         args.SetMaxSendMessageSize(config_.grpc_max_send_message_size);
 
-        grpc_channel_ = grpc::CreateCustomChannel(
-            config_.grpc_addr,
-            grpc::InsecureChannelCredentials(), // 当前使用不安全的连接
-            args
-        );
+        if (config_.grpc_prefer_in_process) {
+            grpc_channel_ = open_in_process_channel(args);
+            if (grpc_channel_) {
+                spdlog::info("gRPC 使用进程内 channel，地址: {}", config_.grpc_addr);
+                return;
+            }
+        }
+
+        if (config_.enable_trace) {
+            grpc_channel_ = grpc::experimental::CreateCustomChannelWithInterceptors(
+                config_.grpc_addr,
+                grpc::InsecureChannelCredentials(),
+                args,
+                trace_interceptors()
+            );
+        } else {
+            grpc_channel_ = grpc::CreateCustomChannel(
+                config_.grpc_addr,
+                grpc::InsecureChannelCredentials(), // 当前使用不安全的连接
+                args
+            );
+        }
 
         if (!grpc_channel_) {
             throw std::runtime_error("无法创建 gRPC channel");
@@ -357,26 +442,17 @@ private:
     /**
      * @brief ZMQ 后台线程的执行函数。
      * @details 负责初始化 ZMQ socket，并在一个循环中接收消息，直到客户端断开连接。
-     * // TODO: 这个函数的核心循环逻辑较长，可以考虑将消息接收部分拆分为一个独立的私有方法，
-     * // 例如 `handle_zmq_reception()`，以提高清晰度。
      */
     void start_zmq() {
         try {
             // 1. 初始化 ZMQ 上下文和 socket
             context_ = std::make_unique<zmq::context_t>(config_.zmq_io_threads);
+            config_.zmq_tuning.apply(*context_);
 
             {
                 std::lock_guard<std::mutex> lock(socket_mutex_);
-                socket_ = std::make_unique<zmq::socket_t>(*context_, config_.zmq_socket_type);
-
-                // 设置 socket 选项
-                socket_->set(zmq::sockopt::linger, config_.zmq_linger_ms);
-                socket_->set(zmq::sockopt::rcvtimeo, config_.zmq_rcv_timeout_ms);
-
-                // 连接到服务器
-                socket_->connect(config_.zmq_addr);
+                open_zmq_socket(*context_);
             }
-            spdlog::info("ZMQ socket 连接成功，地址: {}", config_.zmq_addr);
 
             // 2. 主循环 - 接收消息（仅限可接收的 socket 类型）
             while (connected_.load()) {
@@ -384,15 +460,9 @@ private:
                     config_.zmq_socket_type == zmq::socket_type::pull ||
                     config_.zmq_socket_type == zmq::socket_type::rep) {
 
-                    zmq::message_t message;
                     std::lock_guard<std::mutex> lock(socket_mutex_);
-
                     if (socket_) {
-                        // 使用非阻塞方式接收消息
-                        auto result = socket_->recv(message, zmq::recv_flags::dontwait);
-                        if (result && result.value() > 0 && config_.zmq_message_handler) {
-                            config_.zmq_message_handler(message);
-                        }
+                        handle_zmq_reception();
                     }
                 }
                 // 短暂休眠以避免 CPU 占用过高
@@ -407,6 +477,156 @@ private:
         }
     }
 
+    /** @brief 在给定上下文中创建 socket、应用选项并连接到服务器。*/
+    void open_zmq_socket(zmq::context_t& context) {
+        socket_ = std::make_unique<zmq::socket_t>(context, config_.zmq_socket_type);
+
+        // 设置 socket 选项
+        socket_->set(zmq::sockopt::linger, config_.zmq_linger_ms);
+        socket_->set(zmq::sockopt::rcvtimeo, config_.zmq_rcv_timeout_ms);
+        config_.zmq_tuning.apply(*socket_);
+
+        // 连接到服务器
+        socket_->connect(config_.zmq_addr);
+        spdlog::info("ZMQ socket 连接成功，地址: {}", config_.zmq_addr);
+    }
+
+    /** @brief 检查参数、连接状态与 socket 类型是否允许发送。*/
+    void check_sendable(const void* data, size_t size) const {
+        if (!data || size == 0) {
+            throw std::invalid_argument("无效的消息数据");
+        }
+        if (!connected_.load()) {
+            throw std::runtime_error("客户端未连接，无法发送 ZMQ 消息");
+        }
+
+        // 检查 socket 类型是否支持发送操作
+        if (config_.zmq_socket_type != zmq::socket_type::pub &&
+            config_.zmq_socket_type != zmq::socket_type::push &&
+            config_.zmq_socket_type != zmq::socket_type::req) {
+            throw std::runtime_error("当前的 ZMQ socket 类型不支持发送消息");
+        }
+    }
+
+    /** @brief 发送一次。@returns 以 dontwait 发送且发送缓冲区已满时返回 false。*/
+    bool send_once(const void* data, size_t size, zmq::send_flags flags) {
+        try {
+            bool sent = false;
+            with_socket([&](zmq::socket_t& socket) {
+                zmq::message_t message(size);
+                std::memcpy(message.data(), data, size);
+                sent = socket.send(message, flags).has_value();
+            });
+            return sent;
+        } catch (const zmq::error_t& e) {
+            spdlog::error("发送 ZMQ 消息失败: {}", e.what());
+            throw std::runtime_error("发送 ZMQ 消息失败: " + std::string(e.what()));
+        }
+    }
+
+    /**
+     * @brief 在 socket 所属的线程上下文中执行操作。
+     * @details 独立模式下持有 socket_mutex_ 执行；挂载到共享运行时时转交给其 I/O 线程执行。
+     */
+    template <typename Fn>
+    void with_socket(Fn&& fn) {
+        if (config_.zmq_runtime) {
+            config_.zmq_runtime->invoke([&] {
+                if (socket_) {
+                    fn(*socket_);
+                }
+            });
+            return;
+        }
+        std::lock_guard<std::mutex> lock(socket_mutex_);
+        if (socket_) {
+            fn(*socket_);
+        }
+    }
+
+    /** @brief 在共享运行时的 I/O 线程中创建并注册 socket。*/
+    void attach_zmq_runtime() {
+        auto& runtime = *config_.zmq_runtime;
+        runtime.invoke([this, &runtime] { open_zmq_socket(runtime.context()); });
+
+        std::function<bool()> on_readable;
+        if (config_.zmq_socket_type == zmq::socket_type::sub ||
+            config_.zmq_socket_type == zmq::socket_type::pull ||
+            config_.zmq_socket_type == zmq::socket_type::rep) {
+            // socket 只在 I/O 线程中访问，无需 socket_mutex_
+            on_readable = [this] { return handle_zmq_reception(); };
+        }
+        zmq_registration_ = runtime.add_socket(socket_.get(), std::move(on_readable), nullptr);
+    }
+
+    /** @brief 从共享运行时注销并在其 I/O 线程中关闭 socket。*/
+    void detach_zmq_runtime() {
+        if (!config_.zmq_runtime || zmq_registration_ == 0) {
+            return;
+        }
+        config_.zmq_runtime->invoke([this] {
+            config_.zmq_runtime->remove_socket(zmq_registration_);
+            if (socket_) {
+                socket_->close();
+                socket_.reset();
+            }
+        });
+        zmq_registration_ = 0;
+    }
+
+    /**
+     * @brief 以非阻塞方式接收一条消息并交给处理函数。调用者需持有 socket_mutex_ (或位于共享运行时的 I/O 线程中)。
+     * @returns 是否收到了消息。
+     * @details 只有同时启用 `enable_trace` 与 `trace_zmq_trailer` 时才解析追踪头帧：两帧消息的第二帧大小与 magic
+     * 都匹配时作为追踪头消费，并记录传输与处理耗时；其他多帧消息无法交给单帧的处理函数，整条丢弃并记录日志。
+     * 未启用时保持原有行为，每一帧作为一条消息交给处理函数。
+     */
+    bool handle_zmq_reception() {
+        zmq::message_t message;
+        auto result = socket_->recv(message, zmq::recv_flags::dontwait);
+        if (!result) {
+            return false;
+        }
+
+        const bool parse_trailer = config_.enable_trace && config_.trace_zmq_trailer;
+        mirage_rpc_trace_header header;
+        header.trace_id = 0;
+        const auto recv_ns = parse_trailer ? mirage_rpc_tracer::now_ns() : 0;
+        if (parse_trailer && message.more()) {
+            // 多帧消息是原子投递的，其余帧此时都已可读
+            size_t frames = 1;
+            zmq::message_t trailer;
+            bool has_more = true;
+            while (has_more && socket_->recv(trailer, zmq::recv_flags::dontwait)) {
+                ++frames;
+                has_more = trailer.more();
+            }
+            if (frames == 2 && trailer.size() == sizeof(header)) {
+                std::memcpy(&header, trailer.data(), sizeof(header));
+            }
+            if (frames != 2 || header.magic != mirage_rpc_trace_header::magic_value || header.trace_id == 0) {
+                spdlog::warn("丢弃一条无法识别的 {} 帧 ZMQ 消息", frames);
+                return true;
+            }
+        }
+        if (result.value() == 0) {
+            return true;
+        }
+
+        if (config_.zmq_message_handler) {
+            config_.zmq_message_handler(message);
+        }
+
+        if (parse_trailer && header.trace_id != 0) {
+            auto& tracer = mirage_rpc_tracer::instance();
+            const auto done_ns = mirage_rpc_tracer::now_ns();
+            tracer.record("zmq.wire", header.trace_id, header.dequeue_ns, recv_ns);
+            tracer.record("zmq.handler", header.trace_id, recv_ns, done_ns);
+            tracer.record("zmq.end_to_end", header.trace_id, header.send_ns, done_ns);
+        }
+        return true;
+    }
+
     /** @brief 清理所有分配的资源，如 sockets 和 channels。 */
     void cleanup_resources() {
         try {
@@ -442,6 +662,7 @@ private:
     // ZMQ 相关
     std::unique_ptr<zmq::context_t> context_;
     std::unique_ptr<zmq::socket_t> socket_;
+    mirage_rpc_runtime::registration_id zmq_registration_ = 0; ///< 在共享运行时中的注册 ID，0 表示未注册。
 
     // 线程管理
     std::thread zmq_thread_;
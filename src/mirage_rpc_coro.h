@@ -0,0 +1,663 @@
+#pragma once
+
+#if !defined(__cpp_impl_coroutine)
+#error "mirage_rpc_coro.h 需要 C++20 协程支持，请以 MIRAGE_RPC_ENABLE_COROUTINES=ON 构建并链接 mirage_rpc::coro"
+#endif
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <future>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mirage_rpc_client.h"
+#include "mirage_rpc_server.h"
+
+/**
+ * @file mirage_rpc_coro.h
+ * @brief 基于 C++20 协程的 Mirage RPC 异步 API (可选)。
+ *
+ * 在 `mirage_rpc_server` 与 `mirage_rpc_client` 之上提供可 `co_await` 的接口：
+ * 接收 ZMQ 消息、在发送队列背压时挂起的发送，以及 gRPC 一元调用。
+ * 所有协程都在框架持有的小型执行器 `mirage_rpc_executor` 上恢复执行，
+ * 少量线程即可承载大量并发的逻辑流。
+ */
+
+// --- 执行器 (Executor) ---
+
+/**
+ * @class mirage_rpc_executor
+ * @brief 一个固定线程数的协程执行器。
+ *
+ * 维护一个协程句柄的 FIFO 队列，由工作线程依次恢复。析构时停止并等待所有工作线程退出。
+ * 停止后协程不会被丢弃：队列中尚未恢复的协程以及之后 `post` 的协程都在调用线程上直接恢复，
+ * `schedule()` 则不再挂起并抛出 std::runtime_error，使 `mirage_rpc_sync_wait` 以异常返回而不是一直等待。
+ */
+class mirage_rpc_executor {
+public:
+    explicit mirage_rpc_executor(size_t threads = 2) {
+        if (threads == 0) {
+            throw std::invalid_argument("执行器线程数必须大于 0");
+        }
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back(&mirage_rpc_executor::run, this);
+        }
+    }
+
+    ~mirage_rpc_executor() {
+        stop();
+    }
+
+    mirage_rpc_executor(const mirage_rpc_executor&) = delete;
+    mirage_rpc_executor& operator=(const mirage_rpc_executor&) = delete;
+
+    /**
+     * @brief 获取框架持有的进程级默认执行器。
+     * @details 首次调用时创建，线程数为 2，进程退出时销毁。
+     */
+    static mirage_rpc_executor& instance() {
+        static mirage_rpc_executor executor(2);
+        return executor;
+    }
+
+    /**
+     * @brief 将协程句柄放入队列，由工作线程恢复。
+     * @details 执行器已停止时在调用线程上直接恢复，保证等待中的协程总能继续执行并释放其协程帧。
+     */
+    void post(std::coroutine_handle<> handle) {
+        if (!try_post(handle)) {
+            handle.resume();
+        }
+    }
+
+    /**
+     * @brief 将协程句柄放入队列。
+     * @returns 执行器已停止时返回 false，句柄未被接管。
+     */
+    bool try_post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_) {
+                return false;
+            }
+            queue_.push_back(handle);
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief 返回一个可等待对象，`co_await` 后当前协程将在执行器线程上继续执行。
+     * @throws std::runtime_error (在 `co_await` 处) 如果执行器已停止。
+     * @example
+     *   co_await executor.schedule();
+     */
+    auto schedule() {
+        struct awaitable {
+            mirage_rpc_executor* executor;
+            bool stopped = false;
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> handle) {
+                // 投递成功后协程可能已在其他线程恢复并销毁本对象，只能在失败时写入成员
+                if (executor->try_post(handle)) {
+                    return true;
+                }
+                stopped = true;
+                return false;
+            }
+            void await_resume() const {
+                if (stopped) {
+                    throw std::runtime_error("执行器已停止，无法调度协程");
+                }
+            }
+        };
+        return awaitable{this};
+    }
+
+    /** @brief 停止执行器并等待所有工作线程退出。*/
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_) {
+                return;
+            }
+            stopped_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        // 工作线程已退出，在当前线程上恢复剩余的协程 (此后它们的 post 也会直接恢复)
+        std::deque<std::coroutine_handle<>> remaining;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            remaining.swap(queue_);
+        }
+        if (!remaining.empty()) {
+            spdlog::warn("执行器停止时仍有 {} 个未恢复的协程，在停止线程上恢复", remaining.size());
+        }
+        for (auto handle : remaining) {
+            handle.resume();
+        }
+    }
+
+private:
+    void run() {
+        while (true) {
+            std::coroutine_handle<> handle;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stopped_ || !queue_.empty(); });
+                if (stopped_) {
+                    return;
+                }
+                handle = queue_.front();
+                queue_.pop_front();
+            }
+            handle.resume();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::coroutine_handle<>> queue_;
+    bool stopped_ = false;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+// --- 协程任务 (Task) ---
+
+template <typename T = void>
+class mirage_rpc_task;
+
+namespace mirage_rpc_detail {
+
+/** @brief task 结束时对称转移到等待者，避免深层递归恢复。*/
+struct task_final_awaitable {
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        return handle.promise().continuation;
+    }
+    void await_resume() const noexcept {}
+};
+
+/** @brief 所有 task promise 的公共部分：惰性启动，结束时恢复等待者。*/
+struct task_promise_base {
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr exception;
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    task_final_awaitable final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept {
+        exception = std::current_exception();
+    }
+};
+
+template <typename T>
+struct task_promise : task_promise_base {
+    std::optional<T> value;
+
+    mirage_rpc_task<T> get_return_object() noexcept;
+
+    template <typename U>
+    void return_value(U&& result) {
+        value.emplace(std::forward<U>(result));
+    }
+
+    T result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct task_promise<void> : task_promise_base {
+    mirage_rpc_task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result() {
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+};
+
+/** @brief 立即启动、结束时自行销毁的协程，用于 `mirage_rpc_spawn` 与 `mirage_rpc_sync_wait`。*/
+struct detached_task {
+    struct promise_type {
+        detached_task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept {
+            try {
+                std::rethrow_exception(std::current_exception());
+            } catch (const std::exception& e) {
+                spdlog::error("分离的协程任务抛出异常: {}", e.what());
+            } catch (...) {
+                spdlog::error("分离的协程任务抛出未知异常");
+            }
+        }
+    };
+};
+
+} // namespace mirage_rpc_detail
+
+/**
+ * @class mirage_rpc_task
+ * @brief 惰性启动的协程任务，`co_await` 时才开始执行。
+ * @tparam T 任务的返回值类型。
+ * @details 任务只能被 `co_await` 一次；任务中抛出的异常会在 `co_await` 处重新抛出。
+ */
+template <typename T>
+class [[nodiscard]] mirage_rpc_task {
+public:
+    using promise_type = mirage_rpc_detail::task_promise<T>;
+
+    explicit mirage_rpc_task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    ~mirage_rpc_task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    mirage_rpc_task(const mirage_rpc_task&) = delete;
+    mirage_rpc_task& operator=(const mirage_rpc_task&) = delete;
+
+    mirage_rpc_task(mirage_rpc_task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+
+    mirage_rpc_task& operator=(mirage_rpc_task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    auto operator co_await() && noexcept {
+        struct awaitable {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().continuation = awaiting;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result(); }
+        };
+        return awaitable{handle_};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace mirage_rpc_detail {
+
+template <typename T>
+mirage_rpc_task<T> task_promise<T>::get_return_object() noexcept {
+    return mirage_rpc_task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline mirage_rpc_task<void> task_promise<void>::get_return_object() noexcept {
+    return mirage_rpc_task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+inline detached_task run_detached(mirage_rpc_executor& executor, mirage_rpc_task<void> task) {
+    co_await executor.schedule();
+    co_await std::move(task);
+}
+
+template <typename T>
+detached_task run_with_promise(mirage_rpc_executor& executor, mirage_rpc_task<T> task, std::promise<T> promise) {
+    try {
+        co_await executor.schedule();
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            promise.set_value();
+        } else {
+            promise.set_value(co_await std::move(task));
+        }
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+    }
+}
+
+} // namespace mirage_rpc_detail
+
+/**
+ * @brief 在执行器上启动一个分离的任务，不等待其结果。
+ * @details 任务中未处理的异常只会被记录到日志；执行器已停止时任务不会执行，同样只记录日志。
+ */
+inline void mirage_rpc_spawn(mirage_rpc_executor& executor, mirage_rpc_task<void> task) {
+    mirage_rpc_detail::run_detached(executor, std::move(task));
+}
+
+/**
+ * @brief 在执行器上运行任务，并阻塞当前线程直到其完成。
+ * @details 供 `main` 等非协程上下文使用，不能在执行器线程上调用。
+ * @returns 任务的返回值；任务抛出的异常会在此处重新抛出。
+ * @throws std::runtime_error 如果执行器已停止，任务不会被执行。
+ */
+template <typename T>
+T mirage_rpc_sync_wait(mirage_rpc_executor& executor, mirage_rpc_task<T> task) {
+    std::promise<T> promise;
+    auto future = promise.get_future();
+    mirage_rpc_detail::run_with_promise(executor, std::move(task), std::move(promise));
+    return future.get();
+}
+
+// --- gRPC 一元调用 (gRPC Unary Calls) ---
+
+/**
+ * @brief 将 gRPC 回调式一元调用包装为可等待对象。
+ * @tparam Call 可调用对象，签名为 `void(std::function<void(grpc::Status)>)`，
+ * 负责发起调用并在完成时调用传入的回调。
+ * @details 调用完成后，等待的协程会在执行器上恢复，`co_await` 的结果为 `grpc::Status`。
+ */
+template <typename Call>
+class mirage_rpc_grpc_awaitable {
+public:
+    mirage_rpc_grpc_awaitable(mirage_rpc_executor& executor, Call call)
+        : executor_(&executor), call_(std::move(call)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        // 回调可能在本函数返回之前就恢复协程并销毁本对象，因此先把调用对象移到栈上
+        auto call = std::move(call_);
+        call([this, handle](grpc::Status status) {
+            status_ = std::move(status);
+            executor_->post(handle);
+        });
+    }
+
+    grpc::Status await_resume() { return std::move(status_); }
+
+private:
+    mirage_rpc_executor* executor_;
+    Call call_;
+    grpc::Status status_;
+};
+
+// --- 异步客户端 (Async Client) ---
+
+/**
+ * @class mirage_rpc_async_client
+ * @brief `mirage_rpc_client` 的协程封装。
+ *
+ * 接管配置中的 `zmq_message_handler`，把收到的消息投递给等待中的 `zmq_recv()`；
+ * 没有等待者时暂存在容量有限的收件箱中。投递运行在 ZMQ 接收路径上 (持有客户端的 socket 锁，
+ * 或位于共享运行时唯一的 I/O 线程中)，因此收件箱满时不会阻塞等待，而是丢弃新消息并计入
+ * `zmq_dropped()`；需要无损接收时应增大 `inbox_capacity` 或加快消费。
+ * @example
+ *   mirage_rpc_task<> consume(mirage_rpc_async_client& client) {
+ *       while (auto msg = co_await client.zmq_recv()) {
+ *           spdlog::info("Received: {}", msg->to_string_view());
+ *       }
+ *   }
+ *
+ *   mirage_rpc_async_client client;
+ *   client.connect(cfg);
+ *   client.client().subscribe_topic("");
+ *   mirage_rpc_spawn(client.executor(), consume(client));
+ */
+class mirage_rpc_async_client {
+public:
+    explicit mirage_rpc_async_client(mirage_rpc_executor& executor = mirage_rpc_executor::instance(),
+                                     size_t inbox_capacity = 4096)
+        : executor_(&executor), inbox_capacity_(inbox_capacity == 0 ? 1 : inbox_capacity) {}
+
+    ~mirage_rpc_async_client() {
+        disconnect();
+    }
+
+    mirage_rpc_async_client(const mirage_rpc_async_client&) = delete;
+    mirage_rpc_async_client& operator=(const mirage_rpc_async_client&) = delete;
+
+    /**
+     * @brief 连接到服务器。
+     * @details 配置中已有的 `zmq_message_handler` 会被替换。
+     * @throws std::runtime_error 如果连接失败。
+     */
+    void connect(mirage_rpc_client_config config) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = false;
+        }
+        config.zmq_message_handler = [this](const zmq::message_t& message) { deliver(message); };
+        client_.connect(config);
+    }
+
+    /** @brief 断开连接，并以空结果唤醒所有等待中的 `zmq_recv()`。*/
+    void disconnect() {
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            for (auto* waiter : waiters_) {
+                waiters.push_back(waiter->handle);
+            }
+            waiters_.clear();
+        }
+        for (auto handle : waiters) {
+            executor_->post(handle);
+        }
+        client_.disconnect();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        inbox_.clear();
+    }
+
+    /**
+     * @brief 接收下一条 ZMQ 消息。
+     * @returns 可等待对象，结果为收到的消息；客户端断开后为 `std::nullopt`。
+     */
+    auto zmq_recv() {
+        return recv_awaitable{this, {}, std::nullopt};
+    }
+
+    /**
+     * @brief 以协程方式发起 gRPC 一元调用。
+     * @param call 发起调用的可调用对象，接收完成回调。
+     * @example
+     *   auto stub = client.client().create_stub<Greeter::Stub>();
+     *   grpc::ClientContext ctx;
+     *   grpc::Status status = co_await client.grpc_unary([&](auto done) {
+     *       stub->async()->SayHello(&ctx, &request, &reply, std::move(done));
+     *   });
+     */
+    template <typename Call>
+    auto grpc_unary(Call call) {
+        return mirage_rpc_grpc_awaitable<Call>(*executor_, std::move(call));
+    }
+
+    /** @brief 获取底层的同步客户端，用于订阅主题、创建存根等操作。*/
+    mirage_rpc_client& client() { return client_; }
+
+    /** @brief 因收件箱已满而被丢弃的消息数量。*/
+    uint64_t zmq_dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief 获取恢复协程所用的执行器。*/
+    mirage_rpc_executor& executor() { return *executor_; }
+
+private:
+    struct recv_awaitable {
+        mirage_rpc_async_client* self;
+        std::coroutine_handle<> handle;
+        std::optional<zmq::message_t> result;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> awaiting) {
+            handle = awaiting;
+            {
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                if (!self->inbox_.empty()) {
+                    result.emplace(std::move(self->inbox_.front()));
+                    self->inbox_.pop_front();
+                } else if (!self->closed_) {
+                    self->waiters_.push_back(this);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        std::optional<zmq::message_t> await_resume() { return std::move(result); }
+    };
+
+    /**
+     * @brief 在 ZMQ 接收路径中调用，将消息交给等待者或放入收件箱。
+     * @details 不会阻塞：收件箱已满时丢弃消息并计数，避免慢消费者拖住 socket 锁或共享的 I/O 线程。
+     */
+    void deliver(const zmq::message_t& message) {
+        recv_awaitable* waiter = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_) {
+                return;
+            }
+            if (!waiters_.empty()) {
+                waiter = waiters_.front();
+                waiters_.pop_front();
+                waiter->result.emplace(message.data(), message.size());
+            } else if (inbox_.size() < inbox_capacity_) {
+                inbox_.emplace_back(message.data(), message.size());
+            } else {
+                if (dropped_.fetch_add(1, std::memory_order_relaxed) == 0) {
+                    spdlog::warn("协程客户端收件箱已满 (容量 {})，开始丢弃消息", inbox_capacity_);
+                }
+                return;
+            }
+        }
+        if (waiter) {
+            executor_->post(waiter->handle);
+        }
+    }
+
+    mirage_rpc_executor* executor_;
+    mirage_rpc_client client_;
+
+    size_t inbox_capacity_;
+    std::deque<zmq::message_t> inbox_;
+    std::deque<recv_awaitable*> waiters_;
+    bool closed_ = true;
+    std::atomic<uint64_t> dropped_{0}; ///< 因收件箱已满而丢弃的消息数。
+    std::mutex mutex_;
+};
+
+// --- 异步服务器 (Async Server) ---
+
+/**
+ * @class mirage_rpc_async_server
+ * @brief `mirage_rpc_server` 的协程封装。
+ *
+ * `zmq_send_async` 在发送队列达到 `zmq_send_queue_capacity` 时挂起，
+ * 直到 ZMQ 线程消费了队列中的消息后再恢复重试。未设置容量上限时等同于 `zmq_send`。
+ * 接管配置中的 `zmq_send_space_handler`。
+ */
+class mirage_rpc_async_server {
+public:
+    explicit mirage_rpc_async_server(mirage_rpc_executor& executor = mirage_rpc_executor::instance())
+        : executor_(&executor) {}
+
+    ~mirage_rpc_async_server() {
+        stop();
+    }
+
+    mirage_rpc_async_server(const mirage_rpc_async_server&) = delete;
+    mirage_rpc_async_server& operator=(const mirage_rpc_async_server&) = delete;
+
+    /**
+     * @brief 启动服务器，参数与返回值与 `mirage_rpc_server::start` 相同。
+     * @throws std::runtime_error 如果服务器启动失败。
+     */
+    template <typename... Services>
+    std::future<void> start(mirage_rpc_config config, Services*... services) {
+        config.zmq_send_space_handler = [this] { wake_senders(); };
+        return server_.start(config, services...);
+    }
+
+    /** @brief 停止服务器；挂起的 `zmq_send_async` 会被唤醒并以异常结束。*/
+    void stop() {
+        server_.stop();
+        wake_senders();
+    }
+
+    /** @brief 在期限内优雅地停止服务器，见 `mirage_rpc_server::stop(timeout)`。*/
+    bool stop(std::chrono::milliseconds timeout) {
+        const bool drained = server_.stop(timeout);
+        wake_senders();
+        return drained;
+    }
+
+    /**
+     * @brief 发送一条 ZMQ 消息，发送队列已满时挂起。
+     * @param buffer 待发送的数据，调用者需保证其在 `co_await` 完成前有效。
+     * @throws std::runtime_error 如果服务器未运行。
+     */
+    mirage_rpc_task<void> zmq_send_async(std::string_view buffer) {
+        while (!server_.zmq_try_send(buffer.data(), buffer.size())) {
+            co_await space_awaitable{this};
+        }
+    }
+
+    /** @brief 获取底层的同步服务器。*/
+    mirage_rpc_server& server() { return server_; }
+
+    /** @brief 获取恢复协程所用的执行器。*/
+    mirage_rpc_executor& executor() { return *executor_; }
+
+private:
+    struct space_awaitable {
+        mirage_rpc_async_server* self;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            // 在持锁状态下复查，避免在注册前错过 ZMQ 线程的唤醒
+            if (!self->server_.zmq_send_queue_full() || !self->server_.is_running()) {
+                return false;
+            }
+            self->waiters_.push_back(handle);
+            return true;
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    void wake_senders() {
+        std::vector<std::coroutine_handle<>> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            waiters.swap(waiters_);
+        }
+        for (auto handle : waiters) {
+            executor_->post(handle);
+        }
+    }
+
+    mirage_rpc_executor* executor_;
+    mirage_rpc_server server_;
+
+    std::vector<std::coroutine_handle<>> waiters_;
+    std::mutex mutex_;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @file mirage_rpc_lanes.h
+ * @brief 定义了服务器发送路径上的命名发送通道 (lane)。
+ *
+ * 每个通道拥有独立的有界队列和令牌桶限速。ZMQ 线程以差额轮询 (Deficit Round-Robin) 的方式
+ * 在通道之间调度：每轮为非空且有令牌的通道增加 `quantum` 字节的额度，额度足够时发送队首消息。
+ * 这样一个生产过快的通道只会填满自己的队列，而不会挤占其他通道的发送机会。
+ */
+
+/**
+ * @brief 发送通道的配置。
+ */
+struct mirage_rpc_send_lane_config {
+    std::string name;           ///< 通道名称，"default" 为保留名称。
+    size_t capacity = 0;        ///< 队列容量上限 (消息条数)，0 表示不限制。
+    double rate_limit = 0;      ///< 每秒最多发送的消息数，0 表示不限速。
+    double burst = 0;           ///< 令牌桶容量 (允许的突发消息数)，0 表示取 max(1, rate_limit)，否则不能小于 1。
+    size_t quantum = 64 * 1024; ///< 每轮调度增加的发送额度 (字节)，即通道的带宽权重。
+
+    /**
+     * @brief 验证配置的有效性。
+     * @throws std::invalid_argument 如果任何取值无效。
+     */
+    void validate() const {
+        if (name.empty()) {
+            throw std::invalid_argument("发送通道名称不能为空");
+        }
+        if (rate_limit < 0 || burst < 0) {
+            throw std::invalid_argument("发送通道 '" + name + "' 的限速参数不能为负数");
+        }
+        // 每条消息消耗一个令牌，容量不足 1 时令牌永远攒不够一条消息
+        if (burst > 0 && burst < 1) {
+            throw std::invalid_argument("发送通道 '" + name + "' 的 burst 不能小于 1");
+        }
+        if (quantum == 0) {
+            throw std::invalid_argument("发送通道 '" + name + "' 的 quantum 必须大于 0");
+        }
+    }
+};
+
+/**
+ * @brief 发送通道的运行指标快照。
+ */
+struct mirage_rpc_lane_stats {
+    std::string name;
+    size_t depth = 0;          ///< 当前排队的消息数。
+    uint64_t enqueued = 0;     ///< 累计入队的消息数。
+    uint64_t sent = 0;         ///< 累计被 ZMQ 接受的消息数。
+    uint64_t bytes_sent = 0;   ///< 累计被 ZMQ 接受的字节数。
+    uint64_t rejected = 0;     ///< 因队列已满被拒绝的消息数。
+    uint64_t throttled = 0;    ///< 因令牌不足而延迟发送的消息数 (每条消息最多计一次)。
+    double wait_avg_us = 0;    ///< 平均排队时间 (微秒)。
+    double wait_max_us = 0;    ///< 最大排队时间 (微秒)。
+};
+
+/**
+ * @class mirage_rpc_token_bucket
+ * @brief 以消息条数计的令牌桶。非线程安全，由调用者加锁。
+ */
+class mirage_rpc_token_bucket {
+public:
+    mirage_rpc_token_bucket() = default;
+
+    /**
+     * @param rate 每秒补充的令牌数，0 表示不限速。
+     * @param burst 令牌桶容量，0 表示取 max(1, rate)；小于 1 时按 1 处理。
+     */
+    mirage_rpc_token_bucket(double rate, double burst)
+        : rate_(rate),
+          capacity_(std::max(1.0, burst > 0 ? burst : rate)),
+          tokens_(capacity_),
+          last_refill_(std::chrono::steady_clock::now()) {}
+
+    bool unlimited() const { return rate_ <= 0; }
+
+    /** @brief 按经过的时间补充令牌。*/
+    void refill(std::chrono::steady_clock::time_point now) {
+        if (unlimited()) {
+            return;
+        }
+        const double elapsed = std::chrono::duration<double>(now - last_refill_).count();
+        last_refill_ = now;
+        tokens_ = std::min(capacity_, tokens_ + elapsed * rate_);
+    }
+
+    /** @brief 是否至少有一个令牌。*/
+    bool available() const {
+        return unlimited() || tokens_ >= 1.0;
+    }
+
+    /** @brief 下一个令牌可用的时刻 (以最近一次 `refill` 为基准)，已有令牌时返回 `now`。*/
+    std::chrono::steady_clock::time_point next_token_time(std::chrono::steady_clock::time_point now) const {
+        if (available()) {
+            return now;
+        }
+        const auto wait = std::chrono::duration<double>((1.0 - tokens_) / rate_);
+        return last_refill_ + std::chrono::ceil<std::chrono::steady_clock::duration>(wait);
+    }
+
+    /** @brief 取走一个令牌。@returns 令牌不足时返回 false。*/
+    bool try_take() {
+        if (unlimited()) {
+            return true;
+        }
+        if (tokens_ < 1.0) {
+            return false;
+        }
+        tokens_ -= 1.0;
+        return true;
+    }
+
+    /** @brief 归还一个令牌 (消息未被发送出去时)。*/
+    void give_back() {
+        if (!unlimited()) {
+            tokens_ = std::min(capacity_, tokens_ + 1.0);
+        }
+    }
+
+private:
+    double rate_ = 0;
+    double capacity_ = 1;
+    double tokens_ = 1;
+    std::chrono::steady_clock::time_point last_refill_{};
+};
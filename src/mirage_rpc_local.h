@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 引入第三方库头文件
+#include "grpcpp/grpcpp.h"
+
+/**
+ * @file mirage_rpc_local.h
+ * @brief 定义了进程内 (in-process) 传输的辅助设施。
+ *
+ * 生产者与消费者位于同一进程时，无需经过 TCP 或 IPC：
+ * - ZMQ 的 `inproc://` 地址要求两端共享同一个上下文。服务器和客户端在使用 inproc 地址且
+ *   没有显式配置 `zmq_runtime` 时，会自动挂载到进程级的共享运行时 (`mirage_rpc_runtime::shared_instance()`)。
+ * - gRPC 服务器启动后在本文件的注册表中登记监听地址，客户端启用 `grpc_prefer_in_process` 并连接到匹配的地址时
+ *   改用 `grpc::Server::InProcessChannel`，调用不经过网络协议栈。进程内 channel 固定指向创建时的服务器，
+ *   且 gRPC 不允许在服务器 `Shutdown` 之后通过它发起调用，因此注册表记录每个交出的 channel，
+ *   服务器停止时先等待这些 channel (以及由它们创建的存根) 全部释放再关闭 gRPC 服务器。重启后客户端需要重新连接。
+ */
+
+/** @brief 判断 ZMQ 地址是否为 inproc 地址。*/
+inline bool mirage_rpc_is_inproc(const std::string& zmq_addr) {
+    return zmq_addr.rfind("inproc://", 0) == 0;
+}
+
+/**
+ * @class mirage_rpc_local_registry
+ * @brief 进程内已启动的 gRPC 服务器的注册表。
+ *
+ * 服务器在 `Shutdown` 之前注销，注册表在持锁状态下创建进程内 channel，
+ * 因此不会在服务器停止的过程中创建指向它的 channel；注销时返回仍可能被使用的 channel，供服务器等待其释放。
+ * 同一地址登记了多个服务器时
+ * (例如 `grpc_reuse_port` 平滑重启期间)，选择最近登记的一个。
+ */
+class mirage_rpc_local_registry {
+public:
+    using channel_factory = std::function<std::shared_ptr<grpc::Channel>(grpc::Server&)>;
+
+    static mirage_rpc_local_registry& instance() {
+        static mirage_rpc_local_registry registry;
+        return registry;
+    }
+
+    /**
+     * @brief 登记一个已启动的 gRPC 服务器。
+     * @param addr 配置的监听地址，格式为 "host:port"。
+     * @param port 实际监听的端口 (配置端口为 0 时由系统分配)。
+     * @param server 服务器实例，注销前保持有效。
+     */
+    void add(const std::string& addr, int port, grpc::Server* server) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.push_back(entry{split_host(addr), port, addr, server, {}});
+    }
+
+    /**
+     * @brief 注销一个服务器。返回后不会再有新的 channel 指向它。
+     * @returns 曾为该服务器创建、可能尚未释放的进程内 channel。
+     */
+    std::vector<std::weak_ptr<grpc::Channel>> remove(grpc::Server* server) {
+        std::vector<std::weak_ptr<grpc::Channel>> channels;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (it->server == server) {
+                channels.insert(channels.end(), it->channels.begin(), it->channels.end());
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return channels;
+    }
+
+    /**
+     * @brief 如果地址匹配一个本进程内的服务器，则创建进程内 channel。
+     * @details 地址完全相同，或端口相同且服务器监听通配地址 (0.0.0.0、[::]) 或回环地址、客户端地址为回环地址时视为匹配。
+     * 有多个匹配时选择最近登记的服务器，即平滑重启中接管地址的新实例。
+     * @param addr 客户端配置的服务器地址。
+     * @param factory 在持锁状态下以匹配的服务器创建 channel。
+     * @returns 没有匹配的服务器时返回 nullptr。
+     */
+    std::shared_ptr<grpc::Channel> open_channel(const std::string& addr, const channel_factory& factory) {
+        const std::string host = split_host(addr);
+        const int port = split_port(addr);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.rbegin(); it != entries_.rend(); ++it) {
+            entry& candidate = *it;
+            const bool same_addr = candidate.addr == addr;
+            const bool same_port = port > 0 && candidate.port == port;
+            const bool host_match = candidate.host == host ||
+                                    ((is_wildcard(candidate.host) || is_loopback(candidate.host)) && is_loopback(host));
+            if (same_addr || (same_port && host_match)) {
+                auto channel = factory(*candidate.server);
+                if (channel) {
+                    auto& channels = candidate.channels;
+                    channels.erase(std::remove_if(channels.begin(), channels.end(),
+                                                  [](const auto& weak) { return weak.expired(); }),
+                                   channels.end());
+                    channels.emplace_back(channel);
+                }
+                return channel;
+            }
+        }
+        return nullptr;
+    }
+
+private:
+    struct entry {
+        std::string host;
+        int port;
+        std::string addr;
+        grpc::Server* server;
+        std::vector<std::weak_ptr<grpc::Channel>> channels; ///< 已交出的进程内 channel。
+    };
+
+    mirage_rpc_local_registry() = default;
+
+    static std::string split_host(const std::string& addr) {
+        const auto colon = addr.rfind(':');
+        return colon == std::string::npos ? addr : addr.substr(0, colon);
+    }
+
+    static int split_port(const std::string& addr) {
+        const auto colon = addr.rfind(':');
+        if (colon == std::string::npos || colon + 1 == addr.size()) {
+            return 0;
+        }
+        int port = 0;
+        for (size_t i = colon + 1; i < addr.size(); ++i) {
+            if (addr[i] < '0' || addr[i] > '9' || port > 65535) {
+                return 0;
+            }
+            port = port * 10 + (addr[i] - '0');
+        }
+        return port;
+    }
+
+    static bool is_wildcard(const std::string& host) {
+        return host == "0.0.0.0" || host == "[::]" || host == "::" || host == "*";
+    }
+
+    static bool is_loopback(const std::string& host) {
+        return host == "localhost" || host == "127.0.0.1" || host == "[::1]" || host == "::1";
+    }
+
+    std::mutex mutex_;
+    std::vector<entry> entries_;
+};
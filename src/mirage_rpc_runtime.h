@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 引入第三方库头文件
+#include <spdlog/spdlog.h>
+#include "zmq.hpp"
+#include "mirage_rpc_tuning.h"
+
+/**
+ * @file mirage_rpc_runtime.h
+ * @brief 定义了进程级共享的 ZMQ 运行时。
+ *
+ * 默认情况下每个 `mirage_rpc_server` / `mirage_rpc_client` 都会创建自己的 `zmq::context_t`
+ * 和一个轮询线程。运行时把它们合并为一个共享的上下文和一个多路复用的 I/O 线程：
+ * 该线程用 `zmq::poll` 等待所有已注册 socket 的可读事件，并在每轮循环中调用各实例的
+ * 发送回调。发送回调通过返回值告知下一次需要被调用的时机 (socket 可写时，或令牌桶补充的时刻)，
+ * 轮询超时据此缩短，而不是固定等待 `poll_timeout_ms`。实例通过配置中的 `zmq_runtime` 字段挂载到运行时上。
+ *
+ * ZMQ socket 不是线程安全的，所有已注册 socket 的操作都必须在 I/O 线程中进行，
+ * 其他线程可以通过 `invoke` 把操作转交给 I/O 线程同步执行。
+ */
+
+/**
+ * @class mirage_rpc_runtime
+ * @brief 共享 ZMQ 上下文与多路复用 I/O 线程。
+ *
+ * 禁止拷贝和移动，通过 `std::shared_ptr` 在多个实例之间共享。上下文、注册表与 I/O 线程的状态
+ * 由内部的共享核心持有，I/O 线程同样持有一份引用：最后一个 `shared_ptr` 在 I/O 线程中释放时
+ * (例如在消息处理函数中)，析构函数分离 I/O 线程而不是 join 自身，由 I/O 线程退出时完成清理。
+ * @example
+ *   auto runtime = std::make_shared<mirage_rpc_runtime>();
+ *   for (auto& cfg : client_configs) {
+ *       cfg.zmq_runtime = runtime;
+ *       clients.emplace_back().connect(cfg);
+ *   }
+ */
+class mirage_rpc_runtime {
+public:
+    using registration_id = uint64_t;
+
+    /** @brief 每次可读事件最多连续处理的消息数，也是每轮发送回调的预算，避免单个 socket 饿死其他 socket。*/
+    static constexpr int max_batch = 64;
+
+    /** @brief 发送回调的返回值，决定 I/O 线程下一次调用它的时机。*/
+    struct pump_status {
+        bool blocked = false; ///< 发送缓冲区已满 (EAGAIN)，socket 可写时再次调用。
+        bool more = false;    ///< 预算已用完而仍有可发送的消息，下一轮立即再次调用。
+        std::chrono::steady_clock::time_point next_due = std::chrono::steady_clock::time_point::max(); ///< 最迟在此时刻再次调用 (例如令牌桶补充)。
+    };
+
+    /**
+     * @brief 创建运行时并启动 I/O 线程。
+     * @param io_threads ZMQ 上下文的 I/O 线程数。
+     * @param tuning 上下文级调优 (I/O 线程 CPU 亲和性、ZMQ_BLOCKY)，socket 级选项在此处被忽略。
+     * @param poll_timeout_ms 轮询超时的上限 (毫秒)，即没有唤醒且发送回调没有要求更早调用时的最长等待时间。
+     * @throws zmq::error_t 如果上下文或内部 socket 创建失败。
+     */
+    explicit mirage_rpc_runtime(int io_threads = 1,
+                                const mirage_rpc_zmq_tuning& tuning = mirage_rpc_zmq_tuning{},
+                                int poll_timeout_ms = 100)
+        : core_(std::make_shared<core>(io_threads, poll_timeout_ms)) {
+        tuning.validate();
+        tuning.apply(core_->context);
+        core::start(core_);
+        spdlog::info("ZMQ 共享运行时已启动，I/O 线程数: {}", io_threads);
+    }
+
+    ~mirage_rpc_runtime() {
+        core_->shutdown();
+    }
+
+    mirage_rpc_runtime(const mirage_rpc_runtime&) = delete;
+    mirage_rpc_runtime& operator=(const mirage_rpc_runtime&) = delete;
+
+    /**
+     * @brief 获取进程级的默认运行时。
+     * @details 使用 inproc 地址且没有显式配置 `zmq_runtime` 的服务器和客户端会挂载到该运行时上，
+     * 从而共享 inproc 所要求的同一个上下文。运行时在最后一个使用者释放后销毁，之后再次调用会重新创建。
+     */
+    static std::shared_ptr<mirage_rpc_runtime> shared_instance() {
+        static std::mutex mutex;
+        static std::weak_ptr<mirage_rpc_runtime> instance;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto runtime = instance.lock();
+        if (!runtime) {
+            runtime = std::make_shared<mirage_rpc_runtime>();
+            instance = runtime;
+        }
+        return runtime;
+    }
+
+    /** @brief 获取共享的 ZMQ 上下文。*/
+    zmq::context_t& context() { return core_->context; }
+
+    /**
+     * @brief 在 I/O 线程中同步执行一个操作并返回其结果。
+     * @details 在 I/O 线程中调用时直接执行。操作抛出的异常会在调用者线程中重新抛出。
+     */
+    template <typename Fn>
+    auto invoke(Fn&& fn) -> decltype(fn()) {
+        return core_->invoke(std::forward<Fn>(fn));
+    }
+
+    /**
+     * @brief 注册一个 socket。
+     * @param socket 要轮询的 socket，必须由 `context()` 创建，注销前保持有效。
+     * @param on_readable 可读时的回调，返回 false 表示没有更多消息；为空则不轮询该 socket 的可读事件。
+     * @param on_pump 每轮循环调用的回调，通常用于发送队列中的消息。参数为本轮最多发送的消息数 (`max_batch`)，
+     * 返回下一次需要调用的时机；可以为空。
+     * @returns 注册 ID，用于 `remove_socket`。
+     */
+    registration_id add_socket(zmq::socket_t* socket,
+                               std::function<bool()> on_readable,
+                               std::function<pump_status(int)> on_pump) {
+        return core_->invoke([&] {
+            registration entry;
+            entry.id = core_->next_id++;
+            entry.socket = socket;
+            entry.on_readable = std::move(on_readable);
+            entry.on_pump = std::move(on_pump);
+            core_->registrations.push_back(std::move(entry));
+            return core_->registrations.back().id;
+        });
+    }
+
+    /** @brief 注销一个 socket。返回后运行时不会再访问该 socket 及其回调。*/
+    void remove_socket(registration_id id) {
+        core_->invoke([&] {
+            auto& registrations = core_->registrations;
+            for (auto it = registrations.begin(); it != registrations.end(); ++it) {
+                if (it->id == id) {
+                    registrations.erase(it);
+                    break;
+                }
+            }
+        });
+    }
+
+    /**
+     * @brief 唤醒 I/O 线程，使其立即执行待处理的操作和发送回调。
+     * @details 可在任意线程调用，多次唤醒会被合并。
+     */
+    void wake() {
+        core_->wake();
+    }
+
+    /** @brief 当前已注册的 socket 数量。*/
+    size_t socket_count() {
+        return core_->invoke([this] { return core_->registrations.size(); });
+    }
+
+private:
+    struct registration {
+        registration_id id = 0;
+        zmq::socket_t* socket = nullptr;
+        std::function<bool()> on_readable;
+        std::function<pump_status(int)> on_pump;
+        pump_status last_pump;     ///< 上一次发送回调的结果。
+    };
+
+    /** @brief 运行时的共享状态，由运行时对象与 I/O 线程共同持有。*/
+    struct core {
+        core(int io_threads, int poll_timeout)
+            : context(io_threads), poll_timeout_ms(poll_timeout) {}
+
+        ~core() {
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex);
+                wake_send.reset();
+            }
+            if (!registrations.empty()) {
+                spdlog::warn("ZMQ 共享运行时销毁时仍有 {} 个 socket 未注销", registrations.size());
+            }
+            context.close();
+            spdlog::info("ZMQ 共享运行时已停止");
+        }
+
+        /** @brief 启动 I/O 线程，线程持有 `self` 的一份引用。*/
+        static void start(const std::shared_ptr<core>& self) {
+            self->wake_addr = "inproc://mirage-runtime-wake-" + std::to_string(reinterpret_cast<uintptr_t>(self.get()));
+            std::promise<void> ready;
+            auto ready_future = ready.get_future();
+            self->io_thread = std::thread([self, ready = std::move(ready)]() mutable { self->run(std::move(ready)); });
+            try {
+                ready_future.get();
+            } catch (...) {
+                self->io_thread.join();
+                throw;
+            }
+
+            self->wake_send = std::make_unique<zmq::socket_t>(self->context, zmq::socket_type::pair);
+            self->wake_send->set(zmq::sockopt::linger, 0);
+            self->wake_send->connect(self->wake_addr);
+        }
+
+        /** @brief 通知 I/O 线程退出；在 I/O 线程中调用时分离线程，否则等待其退出。*/
+        void shutdown() {
+            {
+                std::lock_guard<std::mutex> lock(tasks_mutex);
+                stopped = true;
+            }
+            wake();
+            if (!io_thread.joinable()) {
+                return;
+            }
+            if (std::this_thread::get_id() == io_thread_id) {
+                // 不能 join 自身：I/O 线程完成本轮循环后退出，并在释放最后一份引用时完成清理
+                io_thread.detach();
+            } else {
+                io_thread.join();
+            }
+        }
+
+        template <typename Fn>
+        auto invoke(Fn&& fn) -> decltype(fn()) {
+            if (std::this_thread::get_id() == io_thread_id) {
+                return fn();
+            }
+
+            std::packaged_task<decltype(fn())()> task(std::forward<Fn>(fn));
+            auto future = task.get_future();
+            {
+                std::unique_lock<std::mutex> lock(tasks_mutex);
+                if (exited) {
+                    // I/O 线程已结束对 socket 的所有访问，不会再并发，直接在当前线程执行
+                    lock.unlock();
+                    task();
+                    return future.get();
+                }
+                // 运行时正在停止时同样交给 I/O 线程：它在退出前执行完所有已提交的操作
+                tasks.emplace_back([&task] { task(); });
+            }
+            wake();
+            return future.get();
+        }
+
+        void wake() {
+            if (wake_pending.exchange(true, std::memory_order_acq_rel)) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            if (wake_send) {
+                wake_send->send(zmq::const_buffer("", 0), zmq::send_flags::dontwait);
+            }
+        }
+
+        /** @brief I/O 线程的执行函数。*/
+        void run(std::promise<void> ready) {
+            io_thread_id = std::this_thread::get_id();
+            zmq::socket_t wake_recv;
+            try {
+                wake_recv = zmq::socket_t(context, zmq::socket_type::pair);
+                wake_recv.set(zmq::sockopt::linger, 0);
+                wake_recv.bind(wake_addr);
+            } catch (...) {
+                {
+                    std::lock_guard<std::mutex> lock(tasks_mutex);
+                    exited = true;
+                }
+                ready.set_exception(std::current_exception());
+                return;
+            }
+            ready.set_value();
+
+            std::vector<zmq::pollitem_t> items;
+            std::vector<registration*> polled;
+            while (true) {
+                items.clear();
+                polled.clear();
+                items.push_back({wake_recv.handle(), 0, ZMQ_POLLIN, 0});
+                auto next_due = std::chrono::steady_clock::now() + std::chrono::milliseconds(poll_timeout_ms);
+                for (auto& entry : registrations) {
+                    short events = entry.on_readable ? ZMQ_POLLIN : 0;
+                    if (entry.last_pump.blocked) {
+                        events |= ZMQ_POLLOUT;
+                    }
+                    next_due = std::min(next_due, entry.last_pump.more ? std::chrono::steady_clock::time_point{} : entry.last_pump.next_due);
+                    if (events != 0) {
+                        items.push_back({entry.socket->handle(), 0, events, 0});
+                        polled.push_back(&entry);
+                    }
+                }
+
+                try {
+                    zmq::poll(items, poll_timeout_until(next_due));
+                } catch (const zmq::error_t& e) {
+                    spdlog::error("ZMQ 共享运行时轮询失败: {}", e.what());
+                    continue;
+                }
+
+                if (items[0].revents & ZMQ_POLLIN) {
+                    zmq::message_t drop;
+                    while (wake_recv.recv(drop, zmq::recv_flags::dontwait)) {
+                    }
+                    // 先取空再清除标志：之后的 wake() 会重新发送，之前被合并的唤醒由下面的 run_tasks 处理
+                    wake_pending.store(false, std::memory_order_release);
+                }
+
+                if (!run_tasks()) {
+                    break;
+                }
+
+                // 回调可能在 run_tasks 中被注销，跳过已注销的条目
+                for (size_t i = 1; i < items.size() && i - 1 < polled.size(); ++i) {
+                    registration* entry = polled[i - 1];
+                    if ((items[i].revents & ZMQ_POLLIN) && entry->on_readable && is_registered(entry)) {
+                        guarded("接收", [&] {
+                            for (int n = 0; n < max_batch && entry->on_readable(); ++n) {
+                            }
+                        });
+                    }
+                }
+                for (auto& entry : registrations) {
+                    if (entry.on_pump) {
+                        entry.last_pump = pump_status{};
+                        guarded("发送", [&] { entry.last_pump = entry.on_pump(max_batch); });
+                    }
+                }
+            }
+            finish_tasks();
+            wake_recv.close();
+        }
+
+        /** @brief I/O 线程退出前执行剩余的操作，之后的 `invoke` 在调用者线程中执行。*/
+        void finish_tasks() {
+            while (true) {
+                std::deque<std::function<void()>> pending;
+                {
+                    std::lock_guard<std::mutex> lock(tasks_mutex);
+                    if (tasks.empty()) {
+                        exited = true;
+                        return;
+                    }
+                    pending.swap(tasks);
+                }
+                for (auto& task : pending) {
+                    task();
+                }
+            }
+        }
+
+        /** @brief 距 `due` 的轮询超时，向上取整到毫秒，已到期时为 0。*/
+        static std::chrono::milliseconds poll_timeout_until(std::chrono::steady_clock::time_point due) {
+            const auto now = std::chrono::steady_clock::now();
+            if (due <= now) {
+                return std::chrono::milliseconds(0);
+            }
+            return std::chrono::ceil<std::chrono::milliseconds>(due - now);
+        }
+
+        /** @brief 执行所有待处理的操作。返回 false 表示运行时正在停止。*/
+        bool run_tasks() {
+            std::deque<std::function<void()>> pending;
+            bool stopping = false;
+            {
+                std::lock_guard<std::mutex> lock(tasks_mutex);
+                pending.swap(tasks);
+                stopping = stopped;
+            }
+            for (auto& task : pending) {
+                task();
+            }
+            return !stopping;
+        }
+
+        bool is_registered(const registration* entry) const {
+            for (const auto& candidate : registrations) {
+                if (&candidate == entry) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** @brief 执行回调并记录异常，单个实例的错误不会终止共享的 I/O 线程。*/
+        template <typename Fn>
+        void guarded(const char* stage, Fn&& fn) {
+            try {
+                fn();
+            } catch (const std::exception& e) {
+                spdlog::error("ZMQ 共享运行时{}回调发生异常: {}", stage, e.what());
+            }
+        }
+
+        zmq::context_t context;
+        int poll_timeout_ms;
+        std::string wake_addr;
+
+        // I/O 线程
+        std::thread io_thread;
+        std::thread::id io_thread_id;
+        std::list<registration> registrations; ///< 仅由 I/O 线程访问，list 保证注销其他条目时指针不失效。
+        registration_id next_id = 1;
+
+        // 跨线程操作
+        std::mutex tasks_mutex;
+        std::deque<std::function<void()>> tasks;
+        bool stopped = false;
+        bool exited = false; ///< I/O 线程已结束对 socket 的访问 (或未能启动)。
+
+        // 唤醒
+        std::mutex wake_mutex;
+        std::unique_ptr<zmq::socket_t> wake_send;
+        std::atomic<bool> wake_pending{false};
+    };
+
+    std::shared_ptr<core> core_;
+};
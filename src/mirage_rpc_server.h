@@ -1,18 +1,33 @@
 #pragma once
 
-#include <queue>
+#include <algorithm>
+#include <deque>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <climits>
+#include <exception>
+#include <future>
 #include <memory>
+#include <optional>
 #include <functional>
 #include <stdexcept>
+#include <string_view>
 #include <thread>
+#include <vector>
 
 // 引入第三方库头文件
 #include <spdlog/spdlog.h>
 #include "zmq.hpp"
 #include "grpcpp/grpcpp.h"
+#include "mirage_rpc_stream_bridge.h"
+#include "mirage_rpc_trace.h"
+#include "mirage_rpc_tuning.h"
+#include "mirage_rpc_runtime.h"
+#include "mirage_rpc_subscription.h"
+#include "mirage_rpc_lanes.h"
+#include "mirage_rpc_local.h"
 
 /**
  * @file mirage_rpc_server.h
@@ -34,18 +49,33 @@
 struct mirage_rpc_config {
     // --- 核心地址配置 ---
     std::string grpc_addr; ///< gRPC 服务器监听地址，格式为 "ip:port"。
-    std::string zmq_addr;  ///< ZMQ 服务器监听地址，格式可以为 "tcp://ip:port" 或 "ipc:///path/to/socket"。
+    std::string zmq_addr;  ///< ZMQ 服务器监听地址，格式可以为 "tcp://ip:port"、"ipc:///path/to/socket" 或 "inproc://name"。
 
     // --- ZMQ 特定配置 ---
-    zmq::socket_type zmq_socket_type = zmq::socket_type::pub; ///< ZMQ socket 类型，默认为 PUB (发布)。
+    zmq::socket_type zmq_socket_type = zmq::socket_type::pub; ///< ZMQ socket 类型，默认为 PUB (发布)；XPUB 会额外维护订阅索引，见 `zmq_publish`。
     std::function<void(const zmq::message_t&)> zmq_message_handler; ///< ZMQ 消息回调函数 (用于 SUB/PULL/REP 类型)。
     int zmq_io_threads = 1;      ///< ZMQ I/O 线程数。
     int zmq_linger_ms = 0;       ///< socket 关闭前的等待时间(毫秒)，服务器端通常设为 0。
     int zmq_hwm = 1000;          ///< ZMQ 高水位线 (High Water Mark)，用于防止消息队列无限增长。
+    mirage_rpc_zmq_tuning zmq_tuning; ///< socket 与上下文调优 (缓冲区、keepalive、分方向高水位线等)，见 mirage_rpc_tuning.h。
+    std::shared_ptr<mirage_rpc_runtime> zmq_runtime; ///< 可选的共享运行时；设置后使用其上下文和 I/O 线程，zmq_io_threads 与上下文级调优被忽略。
+    size_t zmq_send_queue_capacity = 0;          ///< 默认发送通道的队列容量上限，0 表示不限制。
+    std::vector<mirage_rpc_send_lane_config> zmq_send_lanes; ///< 额外的命名发送通道 (独立队列、限速与调度权重)，见 mirage_rpc_lanes.h。
+    std::function<void()> zmq_send_space_handler; ///< 发送队列被消费后的回调 (仅在某个通道设置了容量上限时调用，运行于 ZMQ 线程)。
+    int zmq_bind_timeout_ms = 0; ///< 地址被占用 (EADDRINUSE) 时重试绑定的最长时间 (毫秒)，用于接替尚未退出的旧进程，0 表示不重试。
 
     // --- gRPC 特定配置 ---
     size_t grpc_max_receive_message_size = 1024 * 1024 * 4; ///< gRPC 允许接收的最大消息大小 (默认 4MB)。
     size_t grpc_max_send_message_size = 1024 * 1024 * 4;    ///< gRPC 允许发送的最大消息大小 (默认 4MB)。
+    bool grpc_stream_bridge = false;                         ///< 是否注册内置的 ZMQ 流式桥接服务 (见 mirage_rpc_stream_bridge.h)。
+    size_t grpc_stream_bridge_capacity = 4096;               ///< 流式桥接共享环形缓冲区的容量 (消息条数)。
+    bool grpc_reuse_port = true;                             ///< 是否启用 SO_REUSEPORT，允许新进程在旧进程停止前绑定同一端口。
+
+    // --- 追踪配置 (见 mirage_rpc_trace.h) ---
+    bool enable_trace = false;          ///< 是否启用端到端延迟追踪，客户端需同时启用。
+    bool trace_zmq_trailer = false;     ///< 是否在被采样的 ZMQ 消息后追加追踪头帧。这会改变线上格式，仅当所有消费者都是启用了同名选项的 Mirage 客户端时开启。
+    uint32_t trace_sample_every = 100;  ///< ZMQ 消息的采样间隔，每 N 条消息采样一次 (gRPC 调用的采样由客户端决定)。
+    std::string trace_export_path;      ///< 追踪文件输出路径 (Chrome trace 格式)，为空则不导出。
 
     // --- 便捷设置函数 (Convenience Setters) ---
 
@@ -72,6 +102,18 @@ struct mirage_rpc_config {
         zmq_addr = "ipc:///tmp/" + name + ".sock";
     }
 
+    /**
+     * @brief 设置 ZMQ 的进程内 (inproc) 监听地址。
+     * @details 同一进程内的客户端使用相同的名称连接，两端会自动共享同一个 ZMQ 上下文。
+     * @param name inproc 端点的唯一名称。
+     */
+    void set_zmq_inproc_addr(const std::string& name) {
+        if (name.empty()) {
+            throw std::invalid_argument("inproc 名称不能为空");
+        }
+        zmq_addr = "inproc://" + name;
+    }
+
     /**
      * @brief 设置 ZMQ 的 TCP 监听地址。
      * @param ip IP 地址，如 "*" 表示监听所有网络接口。
@@ -104,6 +146,8 @@ public:
     }
 
     // --- 资源管理：禁止拷贝，允许移动 ---
+    // 后台线程与共享运行时的回调捕获了对象地址，无法随对象转移：移动时先停止两端，只转移配置，
+    // 移动后的对象处于停止状态，需要重新 start。
     mirage_rpc_server(const mirage_rpc_server&) = delete;
     mirage_rpc_server& operator=(const mirage_rpc_server&) = delete;
 
@@ -114,6 +158,7 @@ public:
     mirage_rpc_server& operator=(mirage_rpc_server&& other) noexcept {
         if (this != &other) {
             stop(); // 先停止并清理当前服务器
+            other.stop(); // 被移动的服务器可能仍在运行，其线程会继续读取 config_
             config_ = std::move(other.config_);
             // 其他成员在 stop 后会被重置，无需移动
         }
@@ -125,10 +170,15 @@ public:
     /**
      * @brief 启动 RPC 服务器。
      * @details 根据配置启动 gRPC 和 ZMQ 服务。gRPC 服务会在一个专用线程中运行，
-     * ZMQ 的消息处理也在另一个专用线程中进行。
+     * ZMQ 的消息处理在另一个专用线程中进行，配置了共享运行时时则由运行时的 I/O 线程处理。
+     * 该方法不等待绑定完成 (两个通道都在后台线程中绑定)，
+     * 返回的 future 在 gRPC 与 ZMQ 都绑定成功后就绪；任一绑定失败时，`get()` 会抛出对应的异常，
+     * 此时仍需调用 `stop()` (或析构服务器) 释放已启动的部分。
      * @tparam Services 可变参数模板，接受一个或多个 gRPC 服务实例的指针。
      * @param config 服务器配置对象。
      * @param services 指向 gRPC 服务实例的指针列表。
+     * @returns 就绪 future。
+     * @throws std::invalid_argument 如果配置无效。
      * @throws std::runtime_error 如果服务器启动失败。
      * @example
      *   MyGreeterService service;
@@ -137,72 +187,157 @@ public:
      *   cfg.set_zmq_tcp_addr("*", 5555);
      *
      *   mirage_rpc_server server;
-     *   server.start(cfg, &service);
+     *   server.start(cfg, &service).get(); // 等待两个通道都绑定完成
      *   // ... 服务器正在运行 ...
-     *   server.stop();
+     *   server.stop(std::chrono::seconds(5));
      */
     template <typename... Services>
-    void start(const mirage_rpc_config& config, Services*... services) {
+    std::future<void> start(const mirage_rpc_config& config, Services*... services) {
         std::lock_guard<std::mutex> lock(mutex_);
 
-        if (running_.load()) {
+        if (started_) {
             spdlog::warn("RPC 服务器已在运行中");
-            return;
+            std::promise<void> ready;
+            ready.set_value();
+            return ready.get_future();
         }
 
+        std::future<void> ready;
         try {
             config_ = config;
             validate_config();
+            build_send_lanes();
+            trace_sampler_.reset(config_.enable_trace ? config_.trace_sample_every : 0);
 
-            // 启动 gRPC 和 ZMQ 的后台线程
-            grpc_thread_ = std::thread(&mirage_rpc_server::start_grpc<Services...>, this, services...);
-            zmq_thread_ = std::thread(&mirage_rpc_server::start_zmq, this);
+            // inproc 要求两端共享上下文，没有显式配置运行时时使用进程级的默认运行时
+            if (mirage_rpc_is_inproc(config_.zmq_addr) && !config_.zmq_runtime) {
+                config_.zmq_runtime = mirage_rpc_runtime::shared_instance();
+            }
 
+            if (config_.enable_trace && !config_.trace_export_path.empty()) {
+                mirage_rpc_tracer::instance().start_export(config_.trace_export_path);
+            }
+
+            if (config_.grpc_stream_bridge) {
+                auto bridge = std::make_unique<mirage_rpc_stream_bridge>(config_.grpc_stream_bridge_capacity);
+                std::lock_guard<std::mutex> bridge_lock(stream_bridge_mutex_);
+                stream_bridge_ = std::move(bridge);
+            }
+
+            startup_ = std::make_shared<startup_state>();
+            ready = startup_->get_future();
+
+            // 必须在启动线程之前设置，否则 ZMQ 线程可能在进入主循环前读到 false 而立即退出
             running_.store(true);
-            spdlog::info("RPC 服务器启动成功 - gRPC: {}, ZMQ: {}", config_.grpc_addr, config_.zmq_addr);
+            accepting_.store(true);
+            stopping_.store(false);
+            started_ = true;
+
+            // ZMQ 使用共享运行时或独立的后台线程；挂载到运行时时由短暂的启动线程完成绑定与注册，
+            // 绑定重试期间不占用 mutex_，stop() 可以随时中止
+            grpc_thread_ = std::thread(&mirage_rpc_server::start_grpc<Services...>, this, services...);
+            zmq_thread_ = std::thread(config_.zmq_runtime ? &mirage_rpc_server::start_zmq_runtime
+                                                          : &mirage_rpc_server::start_zmq,
+                                      this);
 
         } catch (const std::exception& e) {
             spdlog::error("启动服务器失败: {}", e.what());
-            cleanup_resources();
+            // 尚未启动的通道不会再报告结果，代为报告失败，使 shutdown_locked 中的等待能够结束
+            if (startup_) {
+                if (!grpc_thread_.joinable()) {
+                    startup_->fail(startup_channel::grpc, std::current_exception());
+                }
+                if (!zmq_thread_.joinable()) {
+                    startup_->fail(startup_channel::zmq, std::current_exception());
+                }
+            }
+            if (started_) {
+                shutdown_locked(std::nullopt);
+            } else {
+                cleanup_resources();
+            }
             throw;
         }
+        return ready;
     }
 
     /**
-     * @brief 停止 RPC 服务器。
-     * @details 这是一个优雅停机过程。它会关闭 gRPC 服务器，停止 ZMQ 线程，并清理所有资源。
+     * @brief 立即停止 RPC 服务器。
+     * @details 关闭 gRPC 服务器 (等待正在执行的处理函数返回)，停止 ZMQ 线程，并清理所有资源。
+     * 发送队列中尚未发送的消息会被丢弃。关闭 gRPC 服务器之前会等待进程内 channel 全部释放。
      */
     void stop() {
         std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_locked(std::nullopt);
+    }
 
-        if (!running_.load()) {
-            return;
-        }
+    /**
+     * @brief 在期限内优雅地停止 RPC 服务器。
+     * @details 依次执行：停止接受新的 gRPC 调用并等待进行中的调用完成 (到期后取消)；
+     * 拒绝新的 ZMQ 消息并继续发送队列中已有的消息直到队列为空；关闭 ZMQ socket 时在剩余时间内 linger，
+     * 使已交给 ZMQ 的消息继续发送。进程内 channel 最多等待到期限为止。配合 `grpc_reuse_port` / `zmq_bind_timeout_ms`，
+     * 新进程可以在旧进程停止期间接管地址而不丢弃流量。
+     * @param timeout 整个停机过程的期限。
+     * @returns 发送队列是否在期限内被清空；为 false 时剩余的消息已被丢弃。
+     */
+    bool stop(std::chrono::milliseconds timeout) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return shutdown_locked(std::chrono::system_clock::now() + timeout);
+    }
 
-        spdlog::info("正在停止 RPC 服务器...");
-        running_.store(false);
+    // --- ZMQ 相关接口 (ZMQ Interface) ---
 
-        // 唤醒可能在等待的 ZMQ 发送线程
-        cv_.notify_all();
+    /** @brief 发送通道的标识，0 为默认通道。*/
+    using lane_id = size_t;
+    static constexpr lane_id default_lane = 0;
 
-        // 优雅地关闭 gRPC 服务器，这将使 `grpc_server_->Wait()` 返回
-        if (grpc_server_) {
-            grpc_server_->Shutdown();
+    /**
+     * @brief 根据名称查找发送通道。
+     * @param name 通道名称，"default" 表示默认通道。
+     * @throws std::invalid_argument 如果通道不存在。
+     */
+    lane_id zmq_lane(std::string_view name) const {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (lane_id id = 0; id < lanes_.size(); ++id) {
+            if (lanes_[id].config.name == name) {
+                return id;
+            }
         }
+        throw std::invalid_argument("未知的发送通道: " + std::string(name));
+    }
 
-        // 等待两个后台线程完全结束
-        if (grpc_thread_.joinable()) {
-            grpc_thread_.join();
-        }
-        if (zmq_thread_.joinable()) {
-            zmq_thread_.join();
+    /**
+     * @brief 将 ZMQ 消息放入指定发送通道。
+     * @param lane 由 `zmq_lane` 获取的通道标识。
+     * @returns 消息是否已放入队列；通道队列已满时返回 false。
+     * @throws std::runtime_error 如果服务器未运行。
+     * @throws std::invalid_argument 如果 data 为空、size 为 0 或通道不存在。
+     */
+    bool zmq_try_send(lane_id lane, const void* data, size_t size) {
+        if (!data || size == 0) {
+            throw std::invalid_argument("无效的消息数据");
         }
-
-        cleanup_resources();
-        spdlog::info("RPC 服务器已停止");
+        zmq::message_t message(size);
+        std::memcpy(message.data(), data, size);
+        return enqueue(lane, std::move(message));
     }
 
-    // --- ZMQ 相关接口 (ZMQ Interface) ---
+    /**
+     * @brief 获取各发送通道的运行指标。
+     */
+    std::vector<mirage_rpc_lane_stats> zmq_lane_stats() const {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        std::vector<mirage_rpc_lane_stats> result;
+        result.reserve(lanes_.size());
+        for (const auto& lane : lanes_) {
+            mirage_rpc_lane_stats stats = lane.stats;
+            stats.name = lane.config.name;
+            stats.depth = lane.queue.size();
+            stats.wait_avg_us = lane.stats.sent > 0 ? lane.wait_total_us / static_cast<double>(lane.stats.sent) : 0;
+            result.push_back(std::move(stats));
+        }
+        return result;
+    }
 
     /**
      * @brief 将 ZMQ 消息放入发送队列。
@@ -210,30 +345,106 @@ public:
      * 适用于 PUB, PUSH, REP 等 socket 类型。
      * @param data 指向待发送数据的指针。
      * @param size 数据的大小（字节）。
-     * @throws std::runtime_error 如果服务器未运行。
+     * @throws std::runtime_error 如果服务器未运行，或发送队列已达到 `zmq_send_queue_capacity`。
      * @throws std::invalid_argument 如果 data 为空或 size 为 0。
      */
     void zmq_send(const void* data, size_t size) {
-        if (!data || size == 0) {
-            throw std::invalid_argument("无效的消息数据");
+        if (!zmq_try_send(data, size)) {
+            throw std::runtime_error("ZMQ 发送队列已满");
         }
-        if (!running_.load()) {
+    }
+
+    /**
+     * @brief 尝试将 ZMQ 消息放入发送队列。
+     * @details 与 `zmq_send` 相同，但发送队列已满时返回 false 而不是抛出异常，
+     * 调用者可以在 `zmq_send_space_handler` 回调后重试。
+     * @param data 指向待发送数据的指针。
+     * @param size 数据的大小（字节）。
+     * @returns 消息是否已放入队列。
+     * @throws std::runtime_error 如果服务器未运行。
+     * @throws std::invalid_argument 如果 data 为空或 size 为 0。
+     */
+    bool zmq_try_send(const void* data, size_t size) {
+        return zmq_try_send(default_lane, data, size);
+    }
+
+    /**
+     * @brief 按主题发布一条消息，只有在有人订阅该主题时才生成消息体。
+     * @details 发送的消息为 `topic` 与消息体直接拼接而成的单帧，与 SUB 端的前缀匹配一致。
+     * socket 类型为 XPUB 时，服务器根据订阅索引判断是否存在匹配的订阅者，没有时直接返回而不调用
+     * `make_payload`；其他 socket 类型无法得知订阅情况，总是发布。存在流式桥接连接时同样总是发布。
+     * @tparam PayloadFn 无参可调用对象，返回提供 `data()` 与 `size()` 的连续字节容器 (如 std::string)。
+     * @param topic 主题。
+     * @param make_payload 生成消息体的回调，仅在需要发送时调用。
+     * @param lane 发送通道，默认为默认通道。
+     * @returns 消息是否已放入发送队列；没有订阅者而被跳过时返回 false。
+     * @throws std::runtime_error 如果服务器未运行，或通道队列已满。
+     * @example
+     *   server.zmq_publish("md.AAPL", [&] { return quote.SerializeAsString(); });
+     */
+    template <typename PayloadFn>
+    bool zmq_publish(std::string_view topic, PayloadFn&& make_payload, lane_id lane = default_lane) {
+        if (!running_.load() || !accepting_.load()) {
             throw std::runtime_error("服务器未运行，无法发送 ZMQ 消息");
         }
+        if (!zmq_has_subscribers(topic)) {
+            zmq_publish_skipped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
 
-        try {
-            zmq::message_t message(size);
-            std::memcpy(message.data(), data, size);
+        const auto payload = make_payload();
+        const size_t size = topic.size() + payload.size();
+        if (size == 0) {
+            throw std::invalid_argument("无效的消息数据");
+        }
+        zmq::message_t message(size);
+        auto* out = static_cast<char*>(message.data());
+        std::memcpy(out, topic.data(), topic.size());
+        if (payload.size() > 0) {
+            std::memcpy(out + topic.size(), payload.data(), payload.size());
+        }
+        if (!enqueue(lane, std::move(message))) {
+            throw std::runtime_error("ZMQ 发送队列已满");
+        }
+        return true;
+    }
 
-            {
-                std::lock_guard<std::mutex> lock(queue_mutex_);
-                zmq_message_queue_.push(std::move(message));
+    /**
+     * @brief 判断是否有订阅者会收到该主题的消息。
+     * @returns socket 类型不是 XPUB 时总是返回 true。
+     */
+    bool zmq_has_subscribers(std::string_view topic) const {
+        if (config_.zmq_socket_type != zmq::socket_type::xpub) {
+            return true;
+        }
+        {
+            // 可能与 stop() 中释放桥接服务并发，只在锁内访问
+            std::lock_guard<std::mutex> bridge_lock(stream_bridge_mutex_);
+            if (stream_bridge_ && stream_bridge_->has_streams()) {
+                return true;
             }
-            cv_.notify_one(); // 唤醒 ZMQ 线程来处理队列
-        } catch (const std::exception& e) {
-            spdlog::error("准备 ZMQ 消息时失败: {}", e.what());
-            throw;
         }
+        return subscriptions_.matches(topic);
+    }
+
+    /** @brief 因没有订阅者而被 `zmq_publish` 跳过的消息数量。*/
+    uint64_t zmq_publish_skipped() const {
+        return zmq_publish_skipped_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief 获取 XPUB 订阅索引 (仅在 socket 类型为 XPUB 时被维护)。*/
+    const mirage_rpc_subscription_index& zmq_subscriptions() const {
+        return subscriptions_;
+    }
+
+    /**
+     * @brief 检查发送通道的队列是否已达到容量上限。
+     * @param lane 发送通道，默认为默认通道 (容量为 `zmq_send_queue_capacity`)。
+     * @returns 如果该通道设置了容量上限且队列已满，则返回 true。
+     */
+    bool zmq_send_queue_full(lane_id lane = default_lane) const {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        return lane < lanes_.size() && lanes_[lane].full();
     }
 
     /**
@@ -259,13 +470,106 @@ public:
 
     /**
      * @brief 检查服务器是否正在运行。
-     * @returns 如果服务器正在运行，则返回 true；否则返回 false。
+     * @details `start` 返回后即为 true，此时 gRPC 与 ZMQ 通道可能尚未绑定完成 (ZMQ 绑定可能仍在重试)；
+     * 需要确认通道已就绪时应等待 `start` 返回的 future。启动失败或停止后为 false。
+     * @returns 如果服务器已启动且尚未停止，则返回 true；否则返回 false。
      */
     bool is_running() const {
         return running_.load();
     }
 
+    /**
+     * @brief 获取 gRPC 实际监听的端口。
+     * @details 配置的端口为 0 时由系统分配。就绪 future 完成之前返回 0。
+     */
+    int grpc_port() const {
+        return grpc_port_.load();
+    }
+
 private:
+    /** @brief 发送队列中的一条出站消息。*/
+    struct outbound_message {
+        zmq::message_t message;
+        uint64_t trace_id = 0;      ///< 追踪 ID，0 表示未被采样。
+        int64_t trace_send_ns = 0;  ///< 入队时间 (系统时钟纳秒)。
+        bool bridged = false;       ///< 是否已发布到流式桥接，重新入队时避免重复发布。
+        bool throttled = false;     ///< 是否已因令牌不足计入通道的 `throttled` 指标。
+        std::chrono::steady_clock::time_point enqueued_at; ///< 入队时间，用于通道排队时间指标。
+    };
+
+    /** @brief 一个发送通道：独立的队列、令牌桶与 DRR 额度。由 queue_mutex_ 保护。*/
+    struct send_lane {
+        mirage_rpc_send_lane_config config;
+        std::deque<outbound_message> queue; ///< 使用 deque 以便发送失败时放回队首。
+        mirage_rpc_token_bucket bucket;
+        size_t deficit = 0;                 ///< DRR 剩余发送额度 (字节)。
+        mirage_rpc_lane_stats stats;
+        double wait_total_us = 0;
+
+        bool full() const {
+            return config.capacity > 0 && queue.size() >= config.capacity;
+        }
+    };
+
+    /** @brief 参与启动的通道。*/
+    enum class startup_channel { grpc, zmq };
+
+    /**
+     * @brief 汇总 gRPC 与 ZMQ 两个通道的启动结果。
+     * @details 所有通道就绪后完成 promise；任一通道失败时立即以该异常完成，之后的结果只记录不再改变 promise。
+     * 每个通道只计第一次报告。
+     */
+    class startup_state {
+    public:
+        std::future<void> get_future() { return promise_.get_future(); }
+
+        /** @brief 标记一个通道就绪。@returns 是否所有通道都已就绪。*/
+        bool ready(startup_channel channel) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!report(channel) || settled_ || reported_ != all_channels) {
+                return false;
+            }
+            settled_ = true;
+            promise_.set_value();
+            return true;
+        }
+
+        void fail(startup_channel channel, std::exception_ptr error) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            report(channel);
+            if (!settled_) {
+                settled_ = true;
+                promise_.set_exception(error);
+            }
+        }
+
+        /** @brief 等待所有通道都报告了结果 (成功或失败)，此后不会再有通道处于启动过程中。*/
+        void wait() {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return reported_ == all_channels; });
+        }
+
+    private:
+        static constexpr unsigned all_channels = 0b11;
+
+        /** @brief 记录通道的第一次报告并唤醒等待者。@returns 是否为第一次报告。*/
+        bool report(startup_channel channel) {
+            const unsigned bit = 1u << static_cast<unsigned>(channel);
+            if (reported_ & bit) {
+                return false;
+            }
+            reported_ |= bit;
+            cv_.notify_all();
+            return true;
+        }
+
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::promise<void> promise_;
+        unsigned reported_ = 0;
+        bool settled_ = false;
+    };
+
     // --- 私有辅助函数 (Private Helper Functions) ---
 
     /** @brief 验证配置的有效性。*/
@@ -276,6 +580,170 @@ private:
         if (config_.zmq_addr.empty()) {
             throw std::invalid_argument("ZMQ 地址不能为空");
         }
+        if (config_.zmq_bind_timeout_ms < 0) {
+            throw std::invalid_argument("ZMQ 绑定重试时间不能为负数");
+        }
+        for (size_t i = 0; i < config_.zmq_send_lanes.size(); ++i) {
+            const auto& lane = config_.zmq_send_lanes[i];
+            lane.validate();
+            if (lane.name == "default") {
+                throw std::invalid_argument("发送通道名称 'default' 为保留名称");
+            }
+            for (size_t j = 0; j < i; ++j) {
+                if (config_.zmq_send_lanes[j].name == lane.name) {
+                    throw std::invalid_argument("发送通道名称重复: " + lane.name);
+                }
+            }
+        }
+        config_.zmq_tuning.validate();
+    }
+
+    /** @brief 标记一个通道就绪，两个通道都就绪时输出启动日志。*/
+    void mark_ready(startup_channel channel) {
+        spdlog::debug("{} 通道已就绪", channel == startup_channel::grpc ? "gRPC" : "ZMQ");
+        if (startup_->ready(channel)) {
+            spdlog::info("RPC 服务器启动成功 - gRPC: {} (端口 {}), ZMQ: {}",
+                         config_.grpc_addr, grpc_port_.load(), config_.zmq_addr);
+        }
+    }
+
+    /**
+     * @brief 停止服务器的实际实现。调用者需持有 mutex_。
+     * @param deadline 优雅停机的期限；为空时立即停止并丢弃发送队列。
+     * @returns 发送队列是否已被清空。
+     */
+    bool shutdown_locked(std::optional<std::chrono::system_clock::time_point> deadline) {
+        if (!started_) {
+            return true;
+        }
+
+        spdlog::info("正在停止 RPC 服务器...");
+
+        // 中止仍在进行的 ZMQ 绑定重试，使下面的等待不必持续整个 zmq_bind_timeout_ms
+        stopping_.store(true);
+
+        // 等待两个通道都报告启动结果：此后 gRPC 线程要么已发布 grpc_server_，要么已放弃启动
+        if (startup_) {
+            startup_->wait();
+        }
+
+        // 先结束所有桥接流，否则 Shutdown 会一直等待这些长连接
+        if (stream_bridge_) {
+            stream_bridge_->close();
+        }
+
+        // 关闭 gRPC 服务器，这将使 `grpc_server_->Wait()` 返回；带期限时进行中的调用在到期后被取消
+        {
+            std::lock_guard<std::mutex> server_lock(grpc_server_mutex_);
+            if (grpc_server_) {
+                // gRPC 不允许在 Shutdown 之后通过进程内 channel 发起调用，先等待客户端释放它们
+                wait_for_in_process_channels(mirage_rpc_local_registry::instance().remove(grpc_server_.get()),
+                                             deadline);
+                if (deadline) {
+                    grpc_server_->Shutdown(*deadline);
+                } else {
+                    grpc_server_->Shutdown();
+                }
+            }
+        }
+
+        // gRPC 处理函数都已返回，停止接受新的 ZMQ 消息，使发送队列只减不增，继续发送直到队列为空
+        accepting_.store(false);
+        bool drained = true;
+        if (deadline) {
+            drained = wait_for_send_queue(*deadline);
+        }
+
+        running_.store(false);
+
+        // 唤醒可能在等待的 ZMQ 发送线程
+        cv_.notify_all();
+
+        // 等待两个后台线程完全结束
+        if (grpc_thread_.joinable()) {
+            grpc_thread_.join();
+        }
+        if (zmq_thread_.joinable()) {
+            zmq_thread_.join();
+        }
+        if (deadline) {
+            set_close_linger(*deadline);
+        }
+        detach_zmq_runtime();
+
+        cleanup_resources();
+        started_ = false;
+        spdlog::info("RPC 服务器已停止");
+        return drained;
+    }
+
+    /**
+     * @brief 等待进程内 channel 及其存根全部释放。
+     * @details 没有期限时一直等待，超过一秒仍未释放时输出一次警告；到达期限时放弃等待并记录错误，
+     * 此后仍通过这些 channel 发起的调用会使 gRPC 崩溃。
+     */
+    static void wait_for_in_process_channels(std::vector<std::weak_ptr<grpc::Channel>> channels,
+                                             std::optional<std::chrono::system_clock::time_point> deadline) {
+        const auto warn_at = std::chrono::system_clock::now() + std::chrono::seconds(1);
+        bool warned = false;
+        while (true) {
+            channels.erase(std::remove_if(channels.begin(), channels.end(),
+                                          [](const auto& channel) { return channel.expired(); }),
+                           channels.end());
+            if (channels.empty()) {
+                return;
+            }
+            const auto now = std::chrono::system_clock::now();
+            if (deadline && now >= *deadline) {
+                spdlog::error("停止期限已到，仍有 {} 个进程内 gRPC channel 未释放", channels.size());
+                return;
+            }
+            if (!warned && now >= warn_at) {
+                spdlog::warn("等待 {} 个进程内 gRPC channel 释放 (客户端需先 disconnect)", channels.size());
+                warned = true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /** @brief 等待 ZMQ 线程清空发送队列。@returns 是否在期限内清空。*/
+    bool wait_for_send_queue(std::chrono::system_clock::time_point deadline) {
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                if (queued_count_locked() == 0) {
+                    return true;
+                }
+            }
+            if (!running_.load() || std::chrono::system_clock::now() >= deadline) {
+                return false;
+            }
+            if (config_.zmq_runtime) {
+                config_.zmq_runtime->wake();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    /** @brief 将 socket 的 linger 设为距期限的剩余时间，使关闭时已交给 ZMQ 的消息继续发送。*/
+    void set_close_linger(std::chrono::system_clock::time_point deadline) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::system_clock::now()).count();
+        const int linger_ms = static_cast<int>(std::clamp<int64_t>(remaining, 0, INT_MAX));
+        auto apply = [this, linger_ms] {
+            if (socket_) {
+                socket_->set(zmq::sockopt::linger, linger_ms);
+            }
+        };
+        try {
+            if (config_.zmq_runtime && zmq_registration_ != 0) {
+                config_.zmq_runtime->invoke(apply);
+            } else {
+                apply();
+            }
+        } catch (const zmq::error_t& e) {
+            spdlog::warn("设置 ZMQ linger 失败: {}", e.what());
+        }
     }
 
     /**
@@ -289,17 +757,39 @@ private:
 
             // 注册所有传入的服务
             (builder.RegisterService(services), ...);
+            if (stream_bridge_) {
+                builder.RegisterCallbackGenericService(stream_bridge_.get());
+            }
+            if (config_.enable_trace) {
+                std::vector<std::unique_ptr<grpc::experimental::ServerInterceptorFactoryInterface>> interceptors;
+                interceptors.push_back(std::make_unique<mirage_rpc_trace_server_interceptor_factory>());
+                builder.experimental().SetInterceptorCreators(std::move(interceptors));
+            }
 
             // 设置服务器选项
-            builder.AddListeningPort(config_.grpc_addr, grpc::InsecureServerCredentials());
+            int selected_port = 0;
+            builder.AddListeningPort(config_.grpc_addr, grpc::InsecureServerCredentials(), &selected_port);
+            builder.AddChannelArgument(GRPC_ARG_ALLOW_REUSEPORT, config_.grpc_reuse_port ? 1 : 0);
             builder.SetMaxReceiveMessageSize(config_.grpc_max_receive_message_size);
             builder.SetMaxSendMessageSize(config_.grpc_max_send_message_size);
 
-            grpc_server_ = builder.BuildAndStart();
-            if (!grpc_server_) {
-                throw std::runtime_error("无法启动 gRPC 服务器");
+            auto server = builder.BuildAndStart();
+            if (!server || selected_port == 0) {
+                throw std::runtime_error("无法启动 gRPC 服务器，绑定地址失败: " + config_.grpc_addr);
+            }
+            {
+                // 与 shutdown_locked 互斥：停止已开始时不再发布，由本线程自行关闭刚启动的服务器
+                std::lock_guard<std::mutex> server_lock(grpc_server_mutex_);
+                if (stopping_.load()) {
+                    server->Shutdown();
+                    throw std::runtime_error("服务器正在停止，已关闭刚启动的 gRPC 服务器");
+                }
+                grpc_server_ = std::move(server);
+                grpc_port_.store(selected_port);
+                mirage_rpc_local_registry::instance().add(config_.grpc_addr, selected_port, grpc_server_.get());
             }
             spdlog::info("gRPC 服务器已在线程中启动，监听地址: {}", config_.grpc_addr);
+            mark_ready(startup_channel::grpc);
 
             // 阻塞等待，直到 `Shutdown()` 被调用
             grpc_server_->Wait();
@@ -308,6 +798,7 @@ private:
         } catch (const std::exception& e) {
             spdlog::error("gRPC 服务器线程发生异常: {}", e.what());
             running_.store(false);
+            startup_->fail(startup_channel::grpc, std::current_exception());
         }
     }
 
@@ -318,27 +809,16 @@ private:
     void start_zmq() {
         try {
             context_ = std::make_unique<zmq::context_t>(config_.zmq_io_threads);
-            socket_ = std::make_unique<zmq::socket_t>(*context_, config_.zmq_socket_type);
-
-            socket_->set(zmq::sockopt::linger, config_.zmq_linger_ms);
-            socket_->set(zmq::sockopt::sndhwm, config_.zmq_hwm);
-            socket_->set(zmq::sockopt::rcvhwm, config_.zmq_hwm);
-
-            socket_->bind(config_.zmq_addr);
-            spdlog::info("ZMQ socket 绑定成功，地址: {}", config_.zmq_addr);
+            config_.zmq_tuning.apply(*context_);
+            open_zmq_socket(*context_);
+            bind_zmq_socket([this] { socket_->bind(config_.zmq_addr); });
+            mark_ready(startup_channel::zmq);
 
             // 主循环
             while (running_.load()) {
                 // 1. 处理接收消息 (仅适用于可接收的 socket 类型)
-                if (config_.zmq_socket_type == zmq::socket_type::sub ||
-                    config_.zmq_socket_type == zmq::socket_type::pull ||
-                    config_.zmq_socket_type == zmq::socket_type::rep) {
-
-                    zmq::message_t message;
-                    auto result = socket_->recv(message, zmq::recv_flags::dontwait);
-                    if (result && result.value() > 0 && config_.zmq_message_handler) {
-                        config_.zmq_message_handler(message);
-                    }
+                if (zmq_receivable()) {
+                    handle_zmq_reception();
                 }
 
                 // 2. 处理待发送的消息队列
@@ -351,38 +831,372 @@ private:
         } catch (const zmq::error_t& e) {
             spdlog::error("ZMQ 错误: {}", e.what());
             running_.store(false);
+            startup_->fail(startup_channel::zmq, std::current_exception());
         } catch (const std::exception& e) {
             spdlog::error("ZMQ 线程发生未知异常: {}", e.what());
             running_.store(false);
+            startup_->fail(startup_channel::zmq, std::current_exception());
+        }
+    }
+
+    /**
+     * @brief 挂载到共享运行时的 ZMQ 启动线程。
+     * @details 在运行时中创建、绑定并注册 socket 后即退出，之后的收发都在运行时的 I/O 线程中进行。
+     */
+    void start_zmq_runtime() {
+        try {
+            attach_zmq_runtime();
+            mark_ready(startup_channel::zmq);
+        } catch (const std::exception& e) {
+            spdlog::error("ZMQ 挂载到共享运行时失败: {}", e.what());
+            running_.store(false);
+            startup_->fail(startup_channel::zmq, std::current_exception());
+        }
+    }
+
+    /** @brief 在给定上下文中创建 socket 并应用选项。*/
+    void open_zmq_socket(zmq::context_t& context) {
+        socket_ = std::make_unique<zmq::socket_t>(context, config_.zmq_socket_type);
+
+        socket_->set(zmq::sockopt::linger, config_.zmq_linger_ms);
+        config_.zmq_tuning.apply(*socket_, config_.zmq_hwm);
+    }
+
+    /**
+     * @brief 绑定 ZMQ 地址。
+     * @details ZMQ 不支持 SO_REUSEPORT，地址被占用 (例如旧进程仍在停机) 时在 `zmq_bind_timeout_ms` 内重试，
+     * 服务器开始停止时立即放弃重试。
+     * @param bind 执行一次绑定的函数，失败时抛出 zmq::error_t。
+     */
+    template <typename Bind>
+    void bind_zmq_socket(Bind&& bind) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(config_.zmq_bind_timeout_ms);
+        while (true) {
+            try {
+                bind();
+                break;
+            } catch (const zmq::error_t& e) {
+                if (e.num() != EADDRINUSE || std::chrono::steady_clock::now() >= deadline || stopping_.load()) {
+                    throw;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        spdlog::info("ZMQ socket 绑定成功，地址: {}", config_.zmq_addr);
+    }
+
+    /** @brief 当前 socket 类型是否需要接收消息 (XPUB 接收的是订阅消息)。*/
+    bool zmq_receivable() const {
+        return config_.zmq_socket_type == zmq::socket_type::sub ||
+               config_.zmq_socket_type == zmq::socket_type::pull ||
+               config_.zmq_socket_type == zmq::socket_type::rep ||
+               config_.zmq_socket_type == zmq::socket_type::xpub;
+    }
+
+    /**
+     * @brief 以非阻塞方式接收一条消息并交给处理函数。
+     * @returns 是否收到了消息。
+     */
+    bool handle_zmq_reception() {
+        zmq::message_t message;
+        auto result = socket_->recv(message, zmq::recv_flags::dontwait);
+        if (!result) {
+            return false;
+        }
+        if (config_.zmq_socket_type == zmq::socket_type::xpub) {
+            if (subscriptions_.apply_xpub_message(message.data(), message.size())) {
+                spdlog::debug("ZMQ 订阅变化，当前订阅前缀数: {}", subscriptions_.prefix_count());
+            }
+            return true;
+        }
+        if (result.value() > 0 && config_.zmq_message_handler) {
+            config_.zmq_message_handler(message);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 在共享运行时的 I/O 线程中创建并注册 socket。
+     * @details 在 ZMQ 启动线程中调用，绑定重试在该线程中等待；失败时异常经启动 future 报告。
+     */
+    void attach_zmq_runtime() {
+        auto& runtime = *config_.zmq_runtime;
+        runtime.invoke([this, &runtime] { open_zmq_socket(runtime.context()); });
+        // 每次绑定尝试单独转交，重试等待期间不占用共享的 I/O 线程
+        bind_zmq_socket([this, &runtime] { runtime.invoke([this] { socket_->bind(config_.zmq_addr); }); });
+
+        std::function<bool()> on_readable;
+        if (zmq_receivable()) {
+            on_readable = [this] { return handle_zmq_reception(); };
+        }
+        zmq_registration_ = runtime.add_socket(socket_.get(), std::move(on_readable),
+                                                [this](int budget) { return process_send_queue(budget); });
+    }
+
+    /** @brief 从共享运行时注销并在其 I/O 线程中关闭 socket。*/
+    void detach_zmq_runtime() {
+        if (!config_.zmq_runtime || zmq_registration_ == 0) {
+            return;
         }
+        config_.zmq_runtime->invoke([this] {
+            config_.zmq_runtime->remove_socket(zmq_registration_);
+            if (socket_) {
+                socket_->close();
+                socket_.reset();
+            }
+        });
+        zmq_registration_ = 0;
+    }
+
+    /**
+     * @brief 将消息放入发送队列，并按采样间隔标记追踪信息。
+     * @returns 如果发送队列已满，则返回 false。
+     * @throws std::runtime_error 如果服务器未运行。
+     */
+    bool enqueue(lane_id lane, zmq::message_t message) {
+        if (!running_.load() || !accepting_.load()) {
+            throw std::runtime_error("服务器未运行，无法发送 ZMQ 消息");
+        }
+
+        outbound_message outbound;
+        outbound.message = std::move(message);
+        if (config_.enable_trace && trace_sampler_.should_sample()) {
+            outbound.trace_id = mirage_rpc_tracer::instance().next_trace_id();
+            outbound.trace_send_ns = mirage_rpc_tracer::now_ns();
+        }
+
+        outbound.enqueued_at = std::chrono::steady_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (lane >= lanes_.size()) {
+                throw std::invalid_argument("未知的发送通道 ID: " + std::to_string(lane));
+            }
+            send_lane& target = lanes_[lane];
+            if (target.full()) {
+                ++target.stats.rejected;
+                return false;
+            }
+            target.queue.push_back(std::move(outbound));
+            ++target.stats.enqueued;
+        }
+        cv_.notify_one(); // 唤醒 ZMQ 线程来处理队列
+        if (config_.zmq_runtime) {
+            config_.zmq_runtime->wake();
+        }
+        return true;
     }
 
-    /** @brief 处理并发送消息队列中的所有消息。*/
-    void process_send_queue() {
+    /** @brief 根据配置重建发送通道，通道 0 为默认通道。*/
+    void build_send_lanes() {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        lanes_.clear();
+
+        lanes_.emplace_back();
+        lanes_.back().config.name = "default";
+        lanes_.back().config.capacity = config_.zmq_send_queue_capacity;
+        for (const auto& lane_config : config_.zmq_send_lanes) {
+            lanes_.emplace_back();
+            lanes_.back().config = lane_config;
+        }
+        bounded_lanes_ = false;
+        for (auto& lane : lanes_) {
+            lane.bucket = mirage_rpc_token_bucket(lane.config.rate_limit, lane.config.burst);
+            bounded_lanes_ = bounded_lanes_ || lane.config.capacity > 0;
+        }
+        next_lane_ = 0;
+    }
+
+    /** @brief 所有通道中排队的消息总数。调用者需持有 queue_mutex_。*/
+    size_t queued_count_locked() const {
+        size_t count = 0;
+        for (const auto& lane : lanes_) {
+            count += lane.queue.size();
+        }
+        return count;
+    }
+
+    /**
+     * @brief 以差额轮询 (DRR) 的方式发送各通道中的消息。
+     * @details 每轮为非空且有令牌的通道增加 `quantum` 字节的额度，额度足以覆盖队首消息时发送。
+     * 令牌不足的通道在本轮被跳过且不累积额度；ZMQ 拒绝发送 (EAGAIN) 时消息放回原通道队首并结束本次调度。
+     * @param budget 本次最多发送的消息数；共享运行时传入 `max_batch`，避免一个繁忙的服务器独占 I/O 线程。
+     * @returns 下一次需要调度的时机：预算用完时立即，socket 可写时 (EAGAIN)，或最早的令牌补充时刻。
+     * 共享运行时据此设置轮询超时。
+     */
+    mirage_rpc_runtime::pump_status process_send_queue(int budget = INT_MAX) {
+        mirage_rpc_runtime::pump_status status;
+        const auto now = std::chrono::steady_clock::now();
         std::unique_lock<std::mutex> lock(queue_mutex_, std::try_to_lock);
         if (!lock.owns_lock()) {
-            return; // 如果其他地方正在操作队列，则本次跳过
+            // 如果其他地方正在操作队列，则本次跳过，稍后重试
+            status.next_due = now + std::chrono::milliseconds(1);
+            return status;
         }
 
-        while (!zmq_message_queue_.empty() && running_.load()) {
-            try {
-                zmq::message_t message = std::move(zmq_message_queue_.front());
-                zmq_message_queue_.pop();
+        for (auto& lane : lanes_) {
+            lane.bucket.refill(now);
+        }
 
-                // 释放锁后发送，避免阻塞其他线程向队列中添加消息
-                lock.unlock();
-                socket_->send(message, zmq::send_flags::dontwait);
-                lock.lock(); // 重新获取锁以检查循环条件
+        size_t drained = 0;
+        bool socket_blocked = false;
+        bool more = true;
+        bool exhausted = false;
+        while (more && !socket_blocked && !exhausted && running_.load()) {
+            more = false;
+            for (size_t visited = 0; visited < lanes_.size() && !socket_blocked && !exhausted; ++visited) {
+                const size_t index = next_lane_;
+                next_lane_ = (next_lane_ + 1) % lanes_.size();
+                send_lane& lane = lanes_[index];
+                if (lane.queue.empty()) {
+                    lane.deficit = 0;
+                    continue;
+                }
+                if (!lane.bucket.available()) {
+                    note_throttled(lane);
+                    continue;
+                }
 
-            } catch (const zmq::error_t& e) {
-                // EAGAIN 是一个正常的非阻塞错误，表示发送缓冲区已满
-                if (e.num() != EAGAIN) {
-                    spdlog::error("发送 ZMQ 消息失败: {}", e.what());
+                lane.deficit += lane.config.quantum;
+                while (!lane.queue.empty() && lane.queue.front().message.size() <= lane.deficit && running_.load()) {
+                    if (!lane.bucket.try_take()) {
+                        note_throttled(lane);
+                        break;
+                    }
+                    outbound_message outbound = std::move(lane.queue.front());
+                    lane.queue.pop_front();
+                    const size_t size = outbound.message.size(); // 发送成功后 message 会被清空
+
+                    // 释放锁后发送，避免阻塞其他线程向队列中添加消息 (lanes_ 在运行期间不会改变大小)
+                    lock.unlock();
+                    const auto result = send_outbound(outbound);
+                    lock.lock();
+
+                    if (result == send_result::blocked) {
+                        // 发送缓冲区已满 (EAGAIN)：放回队首以保持顺序，等待 socket 可写
+                        lane.bucket.give_back();
+                        lane.queue.push_front(std::move(outbound));
+                        socket_blocked = true;
+                        status.blocked = true;
+                        break;
+                    }
+                    if (result == send_result::accepted) {
+                        lane.deficit -= std::min(lane.deficit, size);
+                        record_sent(lane, outbound, size);
+                        if (++drained >= static_cast<size_t>(budget)) {
+                            exhausted = true;
+                            break;
+                        }
+                    } else {
+                        socket_blocked = true; // 非 EAGAIN 的错误，中断本次发送循环，稍后继续发送剩余消息
+                        status.next_due = std::chrono::steady_clock::now() + std::chrono::milliseconds(1);
+                        break;
+                    }
                 }
-                // 无论何种错误，都中断本次发送循环，等待下次机会
-                break;
+                if (lane.queue.empty()) {
+                    lane.deficit = 0;
+                } else if (lane.bucket.available()) {
+                    more = true; // 仅因额度不足而停止，下一轮继续累积额度
+                }
+            }
+        }
+
+        // 预算用完时有令牌的通道立即再调度；令牌不足而留在队列中的消息，在最早的令牌补充时刻再调度
+        if (!status.blocked) {
+            for (const auto& lane : lanes_) {
+                if (lane.queue.empty()) {
+                    continue;
+                }
+                if (exhausted && lane.bucket.available()) {
+                    status.more = true;
+                }
+                status.next_due = std::min(status.next_due, lane.bucket.next_token_time(now));
+            }
+        }
+
+        // 通知等待队列空间的生产者 (例如协程层的 zmq_send_async)
+        if (drained > 0 && bounded_lanes_ && config_.zmq_send_space_handler) {
+            if (lock.owns_lock()) {
+                lock.unlock();
+            }
+            config_.zmq_send_space_handler();
+        }
+        return status;
+    }
+
+    enum class send_result { accepted, blocked, failed };
+
+    /**
+     * @brief 将一条出站消息交给流式桥接与 ZMQ socket。调用者不得持有 queue_mutex_。
+     * @returns accepted 表示已被接受；blocked 表示发送缓冲区已满 (EAGAIN)，消息保持不变可以重试；
+     * failed 表示发生了不可恢复的错误，消息被丢弃。
+     */
+    send_result send_outbound(outbound_message& outbound) {
+        try {
+            if (stream_bridge_ && !outbound.bridged) {
+                stream_bridge_->publish(outbound.message.data(), outbound.message.size());
+                outbound.bridged = true;
+            }
+            bool accepted = false;
+            if (outbound.trace_id != 0) {
+                accepted = send_traced(outbound);
+            } else {
+                accepted = socket_->send(outbound.message, zmq::send_flags::dontwait).has_value();
             }
+            return accepted ? send_result::accepted : send_result::blocked;
+        } catch (const zmq::error_t& e) {
+            spdlog::error("发送 ZMQ 消息失败: {}", e.what());
+            return send_result::failed;
+        }
+    }
+
+    /**
+     * @brief 记录通道因令牌不足而停止调度。调用者需持有 queue_mutex_。
+     * @details 每条队首消息最多计入一次 `throttled`。额度封顶为 max(quantum, 队首消息大小)，
+     * 避免令牌不足期间累积的额度在令牌恢复后变成超出权重的突发。
+     */
+    static void note_throttled(send_lane& lane) {
+        outbound_message& head = lane.queue.front();
+        if (!head.throttled) {
+            head.throttled = true;
+            ++lane.stats.throttled;
         }
+        lane.deficit = std::min(lane.deficit, std::max(lane.config.quantum, head.message.size()));
+    }
+
+    /** @brief 更新通道的发送指标。调用者需持有 queue_mutex_。*/
+    void record_sent(send_lane& lane, const outbound_message& outbound, size_t size) {
+        const double wait_us = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - outbound.enqueued_at).count();
+        ++lane.stats.sent;
+        lane.stats.bytes_sent += size;
+        lane.wait_total_us += wait_us;
+        lane.stats.wait_max_us = std::max(lane.stats.wait_max_us, wait_us);
+    }
+
+    /**
+     * @brief 发送一条被采样的消息并记录排队耗时；启用 `trace_zmq_trailer` 时在数据帧之后追加追踪头帧。
+     * @details ZMQ 保证多帧消息的原子性，第一帧被接受后其余帧不会因高水位线被拒绝。
+     * @returns 消息是否被 ZMQ 接受；为 false 时消息保持不变，可以重试。
+     */
+    bool send_traced(outbound_message& outbound) {
+        mirage_rpc_trace_header header;
+        header.trace_id = outbound.trace_id;
+        header.send_ns = outbound.trace_send_ns;
+        header.dequeue_ns = mirage_rpc_tracer::now_ns();
+
+        if (!config_.trace_zmq_trailer) {
+            if (!socket_->send(outbound.message, zmq::send_flags::dontwait)) {
+                return false;
+            }
+        } else {
+            if (!socket_->send(outbound.message, zmq::send_flags::dontwait | zmq::send_flags::sndmore)) {
+                return false;
+            }
+            socket_->send(zmq::const_buffer(&header, sizeof(header)), zmq::send_flags::dontwait);
+        }
+        mirage_rpc_tracer::instance().record("zmq.queue", header.trace_id, header.send_ns, header.dequeue_ns);
+        return true;
     }
 
     /** @brief 清理所有分配的资源，如 sockets 和 server 实例。 */
@@ -397,11 +1211,24 @@ private:
                 context_.reset();
             }
             grpc_server_.reset(); // unique_ptr 会自动处理
+            {
+                std::lock_guard<std::mutex> bridge_lock(stream_bridge_mutex_);
+                stream_bridge_.reset(); // 必须在 gRPC 服务器销毁之后释放
+            }
+            startup_.reset();
+            grpc_port_.store(0);
+            subscriptions_.clear();
 
             // 清空可能残留的消息队列
             std::lock_guard<std::mutex> lock(queue_mutex_);
-            std::queue<zmq::message_t> empty_queue;
-            zmq_message_queue_.swap(empty_queue);
+            const size_t discarded = queued_count_locked();
+            if (discarded > 0) {
+                spdlog::warn("停止时丢弃了 {} 条未发送的 ZMQ 消息", discarded);
+            }
+            for (auto& lane : lanes_) {
+                lane.queue.clear();
+                lane.deficit = 0;
+            }
 
         } catch (const std::exception& e) {
             spdlog::error("清理资源时发生错误: {}", e.what());
@@ -415,20 +1242,34 @@ private:
     mirage_rpc_config config_;
 
     // gRPC 相关
-    std::unique_ptr<grpc::Server> grpc_server_;
+    std::unique_ptr<grpc::Server> grpc_server_; ///< 由 gRPC 线程在 grpc_server_mutex_ 下发布。
+    std::mutex grpc_server_mutex_;              ///< 保护 grpc_server_ 的发布与停止时的关闭。
+    std::atomic<int> grpc_port_{0}; ///< gRPC 实际监听的端口。
+    std::unique_ptr<mirage_rpc_stream_bridge> stream_bridge_; ///< 可选的 gRPC 流式桥接服务。
+    mutable std::mutex stream_bridge_mutex_; ///< 保护 stream_bridge_ 的创建与释放，使 zmq_has_subscribers 可随时调用。
 
     // ZMQ 相关
     std::unique_ptr<zmq::context_t> context_;
     std::unique_ptr<zmq::socket_t> socket_;
-    std::queue<zmq::message_t> zmq_message_queue_;
+    std::deque<send_lane> lanes_;                    ///< 发送通道，0 为默认通道；运行期间大小不变。
+    size_t next_lane_ = 0;                           ///< DRR 下一轮开始的通道。
+    bool bounded_lanes_ = false;                     ///< 是否有通道设置了容量上限。
+    mirage_rpc_subscription_index subscriptions_;    ///< XPUB 订阅索引。
+    std::atomic<uint64_t> zmq_publish_skipped_{0};   ///< 因没有订阅者被跳过的发布数量。
+    mirage_rpc_trace_sampler trace_sampler_;         ///< 本实例 ZMQ 消息的采样计数。
+    mirage_rpc_runtime::registration_id zmq_registration_ = 0; ///< 在共享运行时中的注册 ID，0 表示未注册。
 
     // 线程管理
-    std::thread zmq_thread_;
+    std::thread zmq_thread_;  ///< ZMQ 主循环线程；挂载到共享运行时时只负责绑定与注册。
     std::thread grpc_thread_;
     std::atomic<bool> running_{false};
+    std::atomic<bool> accepting_{false};     ///< 是否接受新的 ZMQ 消息，优雅停机的排空阶段为 false。
+    std::atomic<bool> stopping_{false};      ///< 是否已开始停止，用于中止启动阶段的绑定重试。
+    bool started_ = false;                   ///< 线程与资源是否已创建 (由 mutex_ 保护)，启动失败后仍需 stop 清理。
+    std::shared_ptr<startup_state> startup_; ///< 当前一次启动的就绪状态。
 
     // 同步原语
     mutable std::mutex mutex_;         ///< 保护服务器生命周期和配置的互斥锁。
-    mutable std::mutex queue_mutex_;   ///< 保护 ZMQ 消息队列的互斥锁。
+    mutable std::mutex queue_mutex_;   ///< 保护 ZMQ 发送通道的互斥锁。
     std::condition_variable cv_;       ///< 用于唤醒 ZMQ 发送线程的条件变量。
 };
\ No newline at end of file
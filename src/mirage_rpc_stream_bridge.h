@@ -0,0 +1,446 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 引入第三方库头文件
+#include <spdlog/spdlog.h>
+#include "grpcpp/grpcpp.h"
+#include "grpcpp/generic/async_generic_service.h"
+
+/**
+ * @file mirage_rpc_stream_bridge.h
+ * @brief 定义了将 ZMQ 出站消息流桥接为 gRPC server-streaming 方法的内置通用服务。
+ *
+ * 无法访问 ZMQ 端口的消费者可以通过 gRPC 订阅同一份消息流。所有流共享一个扇出环形缓冲区，
+ * 每条消息只编码一次；每个流同一时刻最多只有一个未完成的写操作，慢速的 gRPC 客户端只会
+ * 在环形缓冲区中落后 (并在被覆盖时丢弃旧消息)，而不会阻塞 ZMQ 的发布路径。
+ *
+ * 线上格式等价于下面的 proto 定义，消费者可以直接用它生成存根：
+ * @code
+ *   package mirage.rpc;
+ *   service ZmqBridge {
+ *     rpc Subscribe(ZmqStreamRequest) returns (stream ZmqStreamMessage);
+ *   }
+ *   message ZmqStreamRequest { repeated bytes topics = 1; }   // 前缀过滤，为空表示全部
+ *   message ZmqStreamMessage { bytes payload = 1; uint64 sequence = 2; }
+ * @endcode
+ */
+
+// --- 扇出环形缓冲区 (Fan-out Ring) ---
+
+/**
+ * @brief 环形缓冲区中的一帧，保存已经编码好的 `ZmqStreamMessage`。
+ * @details 帧在发布时只编码一次，之后以共享指针的形式被所有流引用，不再复制。
+ */
+struct mirage_rpc_bridge_frame {
+    std::string encoded;        ///< 编码后的 `ZmqStreamMessage` 字节。
+    size_t payload_offset = 0;  ///< payload 在 encoded 中的起始偏移，用于主题过滤。
+    size_t payload_size = 0;    ///< payload 的长度。
+};
+
+/**
+ * @class mirage_rpc_fanout_ring
+ * @brief 单生产者、多读者的定长环形缓冲区。
+ *
+ * 每个读者持有自己的序号游标。读者落后超过容量时会被移动到最旧的可用帧，
+ * 被跳过的帧计入丢弃数，生产者永远不会因读者而等待。
+ */
+class mirage_rpc_fanout_ring {
+public:
+    explicit mirage_rpc_fanout_ring(size_t capacity)
+        : slots_(capacity == 0 ? 1 : capacity) {}
+
+    /** @brief 发布一帧，返回其序号。*/
+    uint64_t publish(std::shared_ptr<const mirage_rpc_bridge_frame> frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const uint64_t sequence = next_sequence_++;
+        slots_[sequence % slots_.size()] = std::move(frame);
+        return sequence;
+    }
+
+    /**
+     * @brief 读取游标处的帧并前移游标。
+     * @param cursor 读者的序号游标。
+     * @param dropped 累加因落后而被跳过的帧数。
+     * @returns 游标处的帧；如果没有新帧则返回空指针。
+     */
+    std::shared_ptr<const mirage_rpc_bridge_frame> read(uint64_t& cursor, uint64_t& dropped) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cursor >= next_sequence_) {
+            return nullptr;
+        }
+        const uint64_t oldest = next_sequence_ > slots_.size() ? next_sequence_ - slots_.size() : 0;
+        if (cursor < oldest) {
+            dropped += oldest - cursor;
+            cursor = oldest;
+        }
+        return slots_[cursor++ % slots_.size()];
+    }
+
+    /** @brief 下一个将被发布的序号，新读者从这里开始读取。*/
+    uint64_t next_sequence() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return next_sequence_;
+    }
+
+private:
+    std::vector<std::shared_ptr<const mirage_rpc_bridge_frame>> slots_;
+    uint64_t next_sequence_ = 0;
+    mutable std::mutex mutex_;
+};
+
+// --- gRPC 流式桥接服务 (gRPC Stream Bridge) ---
+
+/**
+ * @class mirage_rpc_stream_bridge
+ * @brief 以 server-streaming 方式暴露 ZMQ 出站消息流的通用 gRPC 服务。
+ *
+ * 通过 `grpc::ServerBuilder::RegisterCallbackGenericService` 注册，只响应
+ * `method_name` 对应的方法，其余未注册的方法返回 UNIMPLEMENTED。
+ * `publish` 由 ZMQ 发送线程调用，只做一次编码和一次环形缓冲区写入，
+ * 然后唤醒空闲的流；真正的写操作由各个流根据 gRPC 的写就绪回调自行推进。
+ */
+class mirage_rpc_stream_bridge final : public grpc::CallbackGenericService {
+public:
+    static constexpr const char* method_name = "/mirage.rpc.ZmqBridge/Subscribe";
+
+    explicit mirage_rpc_stream_bridge(size_t capacity) : ring_(capacity) {}
+    ~mirage_rpc_stream_bridge() override = default;
+
+    mirage_rpc_stream_bridge(const mirage_rpc_stream_bridge&) = delete;
+    mirage_rpc_stream_bridge& operator=(const mirage_rpc_stream_bridge&) = delete;
+
+    /**
+     * @brief 将一条 ZMQ 出站消息发布给所有流。
+     * @details 没有活跃流时直接返回，不做任何编码。
+     * @param data 消息数据。
+     * @param size 消息大小（字节）。
+     */
+    void publish(const void* data, size_t size) {
+        if (active_streams_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+
+        auto frame = std::make_shared<mirage_rpc_bridge_frame>();
+        const uint64_t sequence = ring_.next_sequence();
+        frame->encoded.reserve(size + 24);
+        append_tag(frame->encoded, 2, 0);
+        append_varint(frame->encoded, sequence);
+        append_tag(frame->encoded, 1, 2);
+        append_varint(frame->encoded, size);
+        frame->payload_offset = frame->encoded.size();
+        frame->payload_size = size;
+        frame->encoded.append(static_cast<const char*>(data), size);
+
+        ring_.publish(std::move(frame));
+        published_.fetch_add(1, std::memory_order_relaxed);
+
+        for (const auto& stream : snapshot_streams()) {
+            stream->pump();
+        }
+    }
+
+    /**
+     * @brief 结束所有流并拒绝新的订阅。
+     * @details 必须在 `grpc::Server::Shutdown()` 之前调用，否则未结束的流会使 Shutdown 一直等待。
+     */
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(streams_mutex_);
+            closed_ = true;
+        }
+        for (const auto& stream : snapshot_streams()) {
+            stream->finish(grpc::Status::OK);
+        }
+    }
+
+    /** @brief 当前是否有活跃的流。*/
+    bool has_streams() const {
+        return active_streams_.load(std::memory_order_acquire) > 0;
+    }
+
+    /** @brief 当前活跃的流数量。*/
+    size_t stream_count() const {
+        return active_streams_.load(std::memory_order_acquire);
+    }
+
+    /** @brief 已发布到环形缓冲区的消息数。*/
+    uint64_t published_count() const {
+        return published_.load(std::memory_order_relaxed);
+    }
+
+    /** @brief 所有流因落后而被跳过的消息总数。*/
+    uint64_t dropped_count() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    grpc::ServerGenericBidiReactor* CreateReactor(grpc::GenericCallbackServerContext* ctx) override {
+        if (ctx->method() != method_name) {
+            return grpc::CallbackGenericService::CreateReactor(ctx);
+        }
+        auto stream = std::make_shared<stream_reactor>(this);
+        stream->start(stream);
+        return stream.get();
+    }
+
+private:
+    /**
+     * @class stream_reactor
+     * @brief 单个订阅流的 reactor。
+     * @details 生命周期由自身持有的共享指针维持，直到 gRPC 调用 `OnDone`；
+     * 桥接服务只持有弱引用，因此发布线程可以安全地唤醒正在结束的流。
+     */
+    class stream_reactor final : public grpc::ServerGenericBidiReactor {
+    public:
+        explicit stream_reactor(mirage_rpc_stream_bridge* bridge) : bridge_(bridge) {}
+
+        void start(const std::shared_ptr<stream_reactor>& self) {
+            self_ = self;
+            StartRead(&request_);
+        }
+
+        /** @brief 如果没有未完成的写操作，则把下一条匹配的消息写出。*/
+        void pump() {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!subscribed_ || write_pending_ || finishing_) {
+                    return;
+                }
+                auto frame = next_frame_locked();
+                if (!frame) {
+                    return;
+                }
+                auto* holder = new std::shared_ptr<const mirage_rpc_bridge_frame>(std::move(frame));
+                grpc::Slice slice(const_cast<char*>((*holder)->encoded.data()), (*holder)->encoded.size(),
+                                  [](void* p) { delete static_cast<std::shared_ptr<const mirage_rpc_bridge_frame>*>(p); },
+                                  holder);
+                write_buffer_ = grpc::ByteBuffer(&slice, 1);
+                write_pending_ = true;
+            }
+            StartWrite(&write_buffer_);
+        }
+
+        /** @brief 请求结束流；若有未完成的写操作，则在其完成后再结束。*/
+        void finish(const grpc::Status& status) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (finishing_) {
+                    return;
+                }
+                finishing_ = true;
+                final_status_ = status;
+                if (write_pending_) {
+                    return;
+                }
+            }
+            Finish(status);
+        }
+
+        void OnReadDone(bool ok) override {
+            if (ok) {
+                parse_request();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cursor_ = bridge_->ring_.next_sequence();
+                subscribed_ = true;
+            }
+            if (!bridge_->register_stream(self_)) {
+                finish(grpc::Status(grpc::StatusCode::UNAVAILABLE, "ZMQ 流式桥接已关闭"));
+                return;
+            }
+            pump();
+        }
+
+        void OnWriteDone(bool ok) override {
+            bool finish_now = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                write_pending_ = false;
+                write_buffer_.Clear();
+                if (!ok && !finishing_) {
+                    finishing_ = true;
+                    final_status_ = grpc::Status(grpc::StatusCode::CANCELLED, "写入 gRPC 流失败");
+                }
+                finish_now = finishing_;
+            }
+            if (finish_now) {
+                Finish(final_status_);
+                return;
+            }
+            pump();
+        }
+
+        void OnCancel() override {
+            finish(grpc::Status::CANCELLED);
+        }
+
+        void OnDone() override {
+            uint64_t dropped = 0;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                subscribed_ = false;
+                dropped = dropped_;
+            }
+            if (dropped > 0) {
+                spdlog::warn("gRPC 流式桥接订阅者结束，累计丢弃 {} 条消息", dropped);
+            }
+            bridge_->unregister_stream(this);
+            self_.reset(); // 可能在此处析构
+        }
+
+    private:
+        /** @brief 解析 `ZmqStreamRequest`，提取主题前缀列表。*/
+        void parse_request() {
+            std::vector<grpc::Slice> slices;
+            if (!request_.Dump(&slices).ok()) {
+                return;
+            }
+            std::string bytes;
+            for (const auto& slice : slices) {
+                bytes.append(reinterpret_cast<const char*>(slice.begin()), slice.size());
+            }
+
+            size_t pos = 0;
+            while (pos < bytes.size()) {
+                uint64_t key = 0;
+                if (!read_varint(bytes, pos, key)) {
+                    return;
+                }
+                const auto field = key >> 3;
+                const auto wire_type = key & 0x7;
+                uint64_t value = 0;
+                switch (wire_type) {
+                    case 0:
+                        if (!read_varint(bytes, pos, value)) return;
+                        break;
+                    case 1:
+                        pos += 8;
+                        break;
+                    case 2:
+                        if (!read_varint(bytes, pos, value) || value > bytes.size() - pos) return;
+                        if (field == 1) {
+                            topics_.emplace_back(bytes, pos, value);
+                        }
+                        pos += value;
+                        break;
+                    case 5:
+                        pos += 4;
+                        break;
+                    default:
+                        return;
+                }
+            }
+        }
+
+        std::shared_ptr<const mirage_rpc_bridge_frame> next_frame_locked() {
+            while (auto frame = bridge_->ring_.read(cursor_, dropped_)) {
+                if (matches(*frame)) {
+                    return frame;
+                }
+            }
+            return nullptr;
+        }
+
+        bool matches(const mirage_rpc_bridge_frame& frame) const {
+            if (topics_.empty()) {
+                return true;
+            }
+            const char* payload = frame.encoded.data() + frame.payload_offset;
+            for (const auto& topic : topics_) {
+                if (topic.size() <= frame.payload_size && topic.compare(0, topic.size(), payload, topic.size()) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        mirage_rpc_stream_bridge* bridge_;
+        std::shared_ptr<stream_reactor> self_;
+        grpc::ByteBuffer request_;
+        grpc::ByteBuffer write_buffer_;
+        std::vector<std::string> topics_;
+
+        std::mutex mutex_;
+        uint64_t cursor_ = 0;
+        uint64_t dropped_ = 0;
+        bool subscribed_ = false;
+        bool write_pending_ = false;
+        bool finishing_ = false;
+        grpc::Status final_status_;
+
+        friend class mirage_rpc_stream_bridge;
+    };
+
+    bool register_stream(const std::shared_ptr<stream_reactor>& stream) {
+        std::lock_guard<std::mutex> lock(streams_mutex_);
+        if (closed_) {
+            return false;
+        }
+        streams_[stream.get()] = stream;
+        active_streams_.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    void unregister_stream(stream_reactor* stream) {
+        std::lock_guard<std::mutex> lock(streams_mutex_);
+        if (streams_.erase(stream) > 0) {
+            active_streams_.fetch_sub(1, std::memory_order_release);
+            dropped_.fetch_add(stream->dropped_, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<std::shared_ptr<stream_reactor>> snapshot_streams() {
+        std::vector<std::shared_ptr<stream_reactor>> streams;
+        std::lock_guard<std::mutex> lock(streams_mutex_);
+        streams.reserve(streams_.size());
+        for (const auto& entry : streams_) {
+            if (auto stream = entry.second.lock()) {
+                streams.push_back(std::move(stream));
+            }
+        }
+        return streams;
+    }
+
+    // --- protobuf 线上格式辅助函数 ---
+
+    static void append_varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void append_tag(std::string& out, uint32_t field, uint32_t wire_type) {
+        append_varint(out, (static_cast<uint64_t>(field) << 3) | wire_type);
+    }
+
+    static bool read_varint(const std::string& in, size_t& pos, uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 && pos < in.size(); shift += 7) {
+            const auto byte = static_cast<uint8_t>(in[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    mirage_rpc_fanout_ring ring_;
+
+    std::mutex streams_mutex_;
+    std::unordered_map<stream_reactor*, std::weak_ptr<stream_reactor>> streams_;
+    bool closed_ = false;
+
+    std::atomic<size_t> active_streams_{0};
+    std::atomic<uint64_t> published_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
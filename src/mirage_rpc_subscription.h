@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file mirage_rpc_subscription.h
+ * @brief 定义了 XPUB 订阅索引。
+ *
+ * 服务器以 XPUB 模式运行时，订阅者的 subscribe/unsubscribe 会作为消息被 XPUB socket 收到：
+ * 首字节为 1 (订阅) 或 0 (取消订阅)，其余字节为主题前缀。索引用一棵按字节展开的前缀树
+ * 记录当前被订阅的前缀及其引用计数，发布前可以据此判断一个主题是否有人订阅，
+ * 从而在没有订阅者时跳过序列化。
+ *
+ * 注意 XPUB 默认会合并重复的订阅：多个订阅者订阅同一前缀时只会收到一次订阅消息，
+ * 最后一个订阅者取消 (或断开) 时才会收到取消消息，因此计数反映的是 ZMQ 传递的订阅状态变化。
+ */
+
+/**
+ * @class mirage_rpc_subscription_index
+ * @brief 线程安全的主题前缀订阅索引。
+ *
+ * 由 ZMQ 线程更新，发布线程查询；查询使用共享锁，且在没有任何订阅时无需加锁。
+ */
+class mirage_rpc_subscription_index {
+public:
+    /** @brief 增加一个前缀的订阅计数。空前缀表示订阅所有主题。*/
+    void add(std::string_view prefix) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        node* current = &root_;
+        for (unsigned char c : prefix) {
+            auto& child = current->children[c];
+            if (!child) {
+                child = std::make_unique<node>();
+            }
+            current = child.get();
+        }
+        if (current->count++ == 0) {
+            prefix_count_.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * @brief 减少一个前缀的订阅计数，计数归零时删除不再需要的节点。
+     * @returns 如果该前缀之前未被订阅，则返回 false。
+     */
+    bool remove(std::string_view prefix) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        std::vector<node*> path;
+        path.reserve(prefix.size() + 1);
+        path.push_back(&root_);
+        for (unsigned char c : prefix) {
+            auto it = path.back()->children.find(c);
+            if (it == path.back()->children.end()) {
+                return false;
+            }
+            path.push_back(it->second.get());
+        }
+        node* target = path.back();
+        if (target->count == 0) {
+            return false;
+        }
+        if (--target->count == 0) {
+            prefix_count_.fetch_sub(1, std::memory_order_release);
+        }
+
+        // 自底向上裁剪既无订阅也无子节点的节点
+        for (size_t depth = prefix.size(); depth > 0; --depth) {
+            node* current = path[depth];
+            if (current->count > 0 || !current->children.empty()) {
+                break;
+            }
+            path[depth - 1]->children.erase(static_cast<unsigned char>(prefix[depth - 1]));
+        }
+        return true;
+    }
+
+    /**
+     * @brief 判断是否有订阅者会收到以 `topic` 开头的消息。
+     * @returns 如果存在某个已订阅前缀是 `topic` 的前缀，则返回 true。
+     */
+    bool matches(std::string_view topic) const {
+        if (prefix_count_.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const node* current = &root_;
+        if (current->count > 0) {
+            return true;
+        }
+        for (unsigned char c : topic) {
+            auto it = current->children.find(c);
+            if (it == current->children.end()) {
+                return false;
+            }
+            current = it->second.get();
+            if (current->count > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief 应用一条 XPUB 收到的订阅消息。
+     * @param data 消息数据，首字节为 1 (订阅) 或 0 (取消订阅)。
+     * @param size 消息大小。
+     * @returns 如果不是订阅消息 (为空或首字节不是 0/1)，则返回 false。
+     */
+    bool apply_xpub_message(const void* data, size_t size) {
+        if (size == 0) {
+            return false;
+        }
+        const auto* bytes = static_cast<const char*>(data);
+        const std::string_view prefix(bytes + 1, size - 1);
+        switch (bytes[0]) {
+            case 1:
+                add(prefix);
+                return true;
+            case 0:
+                remove(prefix);
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /** @brief 当前被订阅的不同前缀数量。*/
+    size_t prefix_count() const {
+        return prefix_count_.load(std::memory_order_acquire);
+    }
+
+    /** @brief 清空所有订阅。*/
+    void clear() {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        root_.children.clear();
+        root_.count = 0;
+        prefix_count_.store(0, std::memory_order_release);
+    }
+
+private:
+    struct node {
+        std::map<unsigned char, std::unique_ptr<node>> children;
+        uint32_t count = 0; ///< 以该节点结尾的前缀的订阅计数。
+    };
+
+    mutable std::shared_mutex mutex_;
+    node root_;
+    std::atomic<size_t> prefix_count_{0};
+};
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// 引入第三方库头文件
+#include <spdlog/spdlog.h>
+#include "grpcpp/grpcpp.h"
+#include "grpcpp/support/client_interceptor.h"
+#include "grpcpp/support/server_interceptor.h"
+
+/**
+ * @file mirage_rpc_trace.h
+ * @brief 定义了 Mirage RPC 的端到端延迟追踪。
+ *
+ * 追踪是可选的，按 1/N 采样，每个采样来源 (服务器实例、客户端) 持有独立的采样计数。
+ * 被采样的 ZMQ 消息在服务器端记录排队耗时；两端都设置了 `trace_zmq_trailer` 时，服务器还会在数据帧之后
+ * 追加一个追踪头帧，携带 `zmq_send` 入队时间和 `process_send_queue` 出队时间，客户端记录接收时间与
+ * 处理函数结束时间，由此拆分出 队列 / 传输 / 处理 三段耗时。gRPC 调用通过拦截器在元数据中传递发送时间。
+ *
+ * 注意追踪头帧是线上协议的变化：被采样的消息变为两帧，不认识该格式的 PULL/SUB 对端会收到额外的一帧，
+ * 因此只有在所有消费者都是启用了 `trace_zmq_trailer` 的 Mirage 客户端时才应开启。
+ *
+ * 每个线程把 span 写入自己的无锁单生产者环形缓冲区，导出线程定期取出并以
+ * Chrome trace (JSON Array) 格式追加到本地文件，可直接在 chrome://tracing 或 Perfetto 中打开。
+ * 跨进程的传输耗时基于系统时钟计算，依赖两端时钟同步。
+ */
+
+// --- 追踪数据结构 (Trace Records) ---
+
+/**
+ * @brief 随 ZMQ 消息传输的追踪头。
+ * @details 作为两帧消息的第二帧发送，以本机字节序按原样拷贝，要求两端字节序一致。
+ * 客户端只把大小恰为 `sizeof(mirage_rpc_trace_header)` 且 `magic` 匹配的第二帧视为追踪头。
+ */
+struct mirage_rpc_trace_header {
+    static constexpr uint32_t magic_value = 0x4D525448; // "MRTH"
+
+    uint32_t magic = magic_value;
+    uint32_t reserved = 0;
+    uint64_t trace_id = 0;   ///< 追踪 ID，0 表示未采样。
+    int64_t send_ns = 0;     ///< `zmq_send` 入队时间 (系统时钟纳秒)。
+    int64_t dequeue_ns = 0;  ///< `process_send_queue` 出队时间 (系统时钟纳秒)。
+};
+
+/** @brief 一个已结束的 span。name 必须指向静态存储期的字符串。*/
+struct mirage_rpc_span {
+    const char* name = nullptr;
+    uint64_t trace_id = 0;
+    int64_t start_ns = 0;
+    int64_t end_ns = 0;
+    uint32_t thread_id = 0;
+};
+
+/** @brief 某一阶段的耗时统计。*/
+struct mirage_rpc_stage_stats {
+    std::string name;
+    uint64_t count = 0;
+    int64_t total_ns = 0;
+    int64_t max_ns = 0;
+
+    double average_us() const {
+        return count == 0 ? 0.0 : static_cast<double>(total_ns) / static_cast<double>(count) / 1000.0;
+    }
+};
+
+// --- 采样 (Sampling) ---
+
+/**
+ * @class mirage_rpc_trace_sampler
+ * @brief 按 1/N 的比例采样的计数器，线程安全。
+ * @details 每个采样来源各持有一个，互不影响各自配置的采样率。
+ */
+class mirage_rpc_trace_sampler {
+public:
+    /** @param every 采样间隔，0 表示不采样，1 表示全部采样。*/
+    explicit mirage_rpc_trace_sampler(uint32_t every = 0) : every_(every) {}
+
+    /** @brief 重新设置采样间隔并清零计数。不得与 `should_sample` 并发调用。*/
+    void reset(uint32_t every) {
+        every_ = every;
+        counter_.store(0, std::memory_order_relaxed);
+    }
+
+    /** @brief 决定当前事件是否被采样。*/
+    bool should_sample() {
+        if (every_ == 0) {
+            return false;
+        }
+        return (counter_.fetch_add(1, std::memory_order_relaxed) + 1) % every_ == 0;
+    }
+
+private:
+    uint32_t every_;
+    std::atomic<uint64_t> counter_{0};
+};
+
+// --- 每线程环形缓冲区 (Per-thread Ring) ---
+
+/**
+ * @class mirage_rpc_span_ring
+ * @brief 单生产者、单消费者的无锁 span 环形缓冲区。
+ * @details 生产者是所属线程，消费者是导出线程。缓冲区满时丢弃新 span，不会阻塞生产者。
+ */
+class mirage_rpc_span_ring {
+public:
+    mirage_rpc_span_ring(size_t capacity, uint32_t thread_id)
+        : thread_id_(thread_id) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        slots_.resize(rounded);
+        mask_ = rounded - 1;
+    }
+
+    /** @brief 由所属线程调用，写入一个 span。*/
+    bool push(const mirage_rpc_span& span) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        slots_[head & mask_] = span;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** @brief 由导出线程调用，依次取出所有 span。*/
+    template <typename Fn>
+    size_t drain(Fn&& fn) {
+        const size_t head = head_.load(std::memory_order_acquire);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t count = head - tail;
+        for (; tail != head; ++tail) {
+            fn(slots_[tail & mask_]);
+        }
+        tail_.store(tail, std::memory_order_release);
+        return count;
+    }
+
+    uint32_t thread_id() const { return thread_id_; }
+
+    /** @brief 所属线程退出时标记，导出线程取空后回收。*/
+    std::atomic<bool> orphaned{false};
+
+private:
+    std::vector<mirage_rpc_span> slots_;
+    size_t mask_ = 0;
+    uint32_t thread_id_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+// --- 追踪器 (Tracer) ---
+
+/**
+ * @class mirage_rpc_tracer
+ * @brief 进程级的追踪器，负责 span 记录、阶段统计和文件导出 (采样见 `mirage_rpc_trace_sampler`)。
+ */
+class mirage_rpc_tracer {
+public:
+    static constexpr size_t ring_capacity = 8192;
+
+    static mirage_rpc_tracer& instance() {
+        static mirage_rpc_tracer tracer;
+        return tracer;
+    }
+
+    ~mirage_rpc_tracer() {
+        stop_export();
+    }
+
+    mirage_rpc_tracer(const mirage_rpc_tracer&) = delete;
+    mirage_rpc_tracer& operator=(const mirage_rpc_tracer&) = delete;
+
+    /** @brief 当前系统时钟时间 (纳秒)，可跨进程比较。*/
+    static int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /** @brief 生成一个新的非零追踪 ID。*/
+    uint64_t next_trace_id() {
+        return next_trace_id_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 记录一个已结束的 span。
+     * @param name 阶段名称，必须是字符串字面量等静态存储期的字符串。
+     */
+    void record(const char* name, uint64_t trace_id, int64_t start_ns, int64_t end_ns) {
+        auto& ring = local_ring();
+        mirage_rpc_span span;
+        span.name = name;
+        span.trace_id = trace_id;
+        span.start_ns = start_ns;
+        span.end_ns = end_ns;
+        span.thread_id = ring.thread_id();
+        if (!ring.push(span)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 启动导出线程，把 span 以 Chrome trace 格式追加写入文件。
+     * @details 进程内只允许一个导出目标，重复调用会被忽略。
+     * @param path 输出文件路径。
+     * @param interval 导出间隔。
+     */
+    void start_export(const std::string& path,
+                      std::chrono::milliseconds interval = std::chrono::milliseconds(200)) {
+        std::lock_guard<std::mutex> lock(export_mutex_);
+        if (output_.is_open()) {
+            if (path != export_path_) {
+                spdlog::warn("追踪导出已在进行中 ({}), 忽略新的导出路径: {}", export_path_, path);
+            }
+            return;
+        }
+        output_.open(path, std::ios::out | std::ios::trunc);
+        if (!output_) {
+            throw std::runtime_error("无法打开追踪输出文件: " + path);
+        }
+        output_ << "[\n";
+        export_path_ = path;
+        exporting_ = true;
+        exporter_ = std::thread([this, interval] {
+            std::unique_lock<std::mutex> wait_lock(export_mutex_);
+            while (exporting_) {
+                export_cv_.wait_for(wait_lock, interval);
+                drain_locked();
+            }
+        });
+        spdlog::info("追踪导出已启动，输出文件: {}", path);
+    }
+
+    /** @brief 停止导出线程，写出剩余的 span 并关闭文件。*/
+    void stop_export() {
+        {
+            std::lock_guard<std::mutex> lock(export_mutex_);
+            if (!exporting_) {
+                return;
+            }
+            exporting_ = false;
+        }
+        export_cv_.notify_all();
+        if (exporter_.joinable()) {
+            exporter_.join();
+        }
+        std::lock_guard<std::mutex> lock(export_mutex_);
+        drain_locked();
+        output_.close();
+    }
+
+    /**
+     * @brief 立即取出所有线程中的 span，更新阶段统计并 (若正在导出) 写入文件。
+     * @returns 取出的 span 数量。
+     */
+    size_t drain() {
+        std::lock_guard<std::mutex> lock(export_mutex_);
+        return drain_locked();
+    }
+
+    /** @brief 获取各阶段的耗时统计 (仅包含已被 drain 的 span)。*/
+    std::vector<mirage_rpc_stage_stats> stage_stats() const {
+        std::lock_guard<std::mutex> lock(export_mutex_);
+        std::vector<mirage_rpc_stage_stats> result;
+        result.reserve(stats_.size());
+        for (const auto& entry : stats_) {
+            result.push_back(entry.second);
+        }
+        return result;
+    }
+
+    /** @brief 以日志形式输出各阶段的耗时分解。*/
+    void log_summary() {
+        drain();
+        for (const auto& stage : stage_stats()) {
+            spdlog::info("追踪阶段 {:<16} 次数: {:>8}  平均: {:>10.2f} us  最大: {:>10.2f} us",
+                         stage.name, stage.count, stage.average_us(), static_cast<double>(stage.max_ns) / 1000.0);
+        }
+        if (dropped_count() > 0) {
+            spdlog::warn("追踪环形缓冲区溢出，丢弃了 {} 个 span", dropped_count());
+        }
+    }
+
+    /** @brief 因环形缓冲区已满而丢弃的 span 数。*/
+    uint64_t dropped_count() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    mirage_rpc_tracer() = default;
+
+    /** @brief 线程退出时把自己的环形缓冲区标记为孤立。*/
+    struct ring_owner {
+        std::shared_ptr<mirage_rpc_span_ring> ring;
+        ~ring_owner() {
+            if (ring) {
+                ring->orphaned.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    mirage_rpc_span_ring& local_ring() {
+        thread_local ring_owner owner;
+        if (!owner.ring) {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            owner.ring = std::make_shared<mirage_rpc_span_ring>(ring_capacity, next_thread_id_++);
+            rings_.push_back(owner.ring);
+        }
+        return *owner.ring;
+    }
+
+    /** @brief 调用者需持有 export_mutex_。*/
+    size_t drain_locked() {
+        std::vector<std::shared_ptr<mirage_rpc_span_ring>> rings;
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            rings = rings_;
+        }
+
+        size_t drained = 0;
+        for (const auto& ring : rings) {
+            const bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+            drained += ring->drain([this](const mirage_rpc_span& span) { consume(span); });
+            if (orphaned) {
+                std::lock_guard<std::mutex> lock(rings_mutex_);
+                rings_.erase(std::remove(rings_.begin(), rings_.end(), ring), rings_.end());
+            }
+        }
+        if (output_.is_open() && drained > 0) {
+            output_.flush();
+        }
+        return drained;
+    }
+
+    void consume(const mirage_rpc_span& span) {
+        const int64_t duration = span.end_ns - span.start_ns;
+        auto it = stats_.find(std::string_view(span.name));
+        if (it == stats_.end()) {
+            mirage_rpc_stage_stats stage;
+            stage.name = span.name;
+            it = stats_.emplace(span.name, std::move(stage)).first;
+        }
+        auto& stage = it->second;
+        ++stage.count;
+        stage.total_ns += duration;
+        stage.max_ns = std::max(stage.max_ns, duration);
+
+        if (output_.is_open()) {
+            output_ << "{\"name\":\"" << span.name << "\",\"cat\":\"mirage\",\"ph\":\"X\""
+                    << ",\"ts\":" << format_micros(span.start_ns)
+                    << ",\"dur\":" << format_micros(duration)
+                    << ",\"pid\":" << process_id() << ",\"tid\":" << span.thread_id
+                    << ",\"args\":{\"trace_id\":" << span.trace_id << "}},\n";
+        }
+    }
+
+    /**
+     * @brief 将纳秒格式化为带符号、保留三位小数的微秒 (Chrome trace 的时间单位)。
+     * @details 跨进程的阶段 (例如 zmq.wire) 由两端时钟相减得到，时钟偏差可能使其为负或小于 1 微秒。
+     */
+    static std::string format_micros(int64_t ns) {
+        const uint64_t magnitude = ns < 0 ? 0 - static_cast<uint64_t>(ns) : static_cast<uint64_t>(ns);
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%s%llu.%03llu", ns < 0 ? "-" : "",
+                      static_cast<unsigned long long>(magnitude / 1000),
+                      static_cast<unsigned long long>(magnitude % 1000));
+        return buffer;
+    }
+
+    static int process_id() {
+#ifdef _WIN32
+        return _getpid();
+#else
+        return static_cast<int>(::getpid());
+#endif
+    }
+
+    std::atomic<uint64_t> next_trace_id_{1};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::mutex rings_mutex_;
+    std::vector<std::shared_ptr<mirage_rpc_span_ring>> rings_;
+    uint32_t next_thread_id_ = 1;
+
+    mutable std::mutex export_mutex_;
+    std::condition_variable export_cv_;
+    std::thread exporter_;
+    std::ofstream output_;
+    std::string export_path_;
+    bool exporting_ = false; ///< 导出线程是否应继续运行。
+    std::map<std::string, mirage_rpc_stage_stats, std::less<>> stats_;
+};
+
+// --- gRPC 拦截器 (gRPC Interceptors) ---
+
+/** @brief gRPC 元数据中的追踪键名。*/
+inline constexpr const char* mirage_rpc_trace_id_key = "mirage-trace-id";
+inline constexpr const char* mirage_rpc_trace_send_key = "mirage-trace-send-ns";
+
+/**
+ * @class mirage_rpc_trace_client_interceptor
+ * @brief 客户端拦截器：对被采样的调用写入追踪元数据，并记录 `grpc.client` span。
+ */
+class mirage_rpc_trace_client_interceptor final : public grpc::experimental::Interceptor {
+public:
+    explicit mirage_rpc_trace_client_interceptor(mirage_rpc_trace_sampler& sampler) : sampler_(sampler) {}
+
+    void Intercept(grpc::experimental::InterceptorBatchMethods* methods) override {
+        using hook = grpc::experimental::InterceptionHookPoints;
+        auto& tracer = mirage_rpc_tracer::instance();
+
+        if (methods->QueryInterceptionHookPoint(hook::PRE_SEND_INITIAL_METADATA) && sampler_.should_sample()) {
+            trace_id_ = tracer.next_trace_id();
+            start_ns_ = mirage_rpc_tracer::now_ns();
+            auto* metadata = methods->GetSendInitialMetadata();
+            metadata->emplace(mirage_rpc_trace_id_key, std::to_string(trace_id_));
+            metadata->emplace(mirage_rpc_trace_send_key, std::to_string(start_ns_));
+        }
+        if (methods->QueryInterceptionHookPoint(hook::POST_RECV_STATUS) && trace_id_ != 0) {
+            tracer.record("grpc.client", trace_id_, start_ns_, mirage_rpc_tracer::now_ns());
+        }
+        methods->Proceed();
+    }
+
+private:
+    mirage_rpc_trace_sampler& sampler_;
+    uint64_t trace_id_ = 0;
+    int64_t start_ns_ = 0;
+};
+
+/** @brief 客户端拦截器工厂，同一工厂创建的拦截器共享一个采样计数。*/
+class mirage_rpc_trace_client_interceptor_factory final
+    : public grpc::experimental::ClientInterceptorFactoryInterface {
+public:
+    explicit mirage_rpc_trace_client_interceptor_factory(std::shared_ptr<mirage_rpc_trace_sampler> sampler)
+        : sampler_(std::move(sampler)) {}
+
+    grpc::experimental::Interceptor* CreateClientInterceptor(grpc::experimental::ClientRpcInfo*) override {
+        return new mirage_rpc_trace_client_interceptor(*sampler_);
+    }
+
+private:
+    std::shared_ptr<mirage_rpc_trace_sampler> sampler_;
+};
+
+/**
+ * @class mirage_rpc_trace_server_interceptor
+ * @brief 服务器拦截器：读取追踪元数据，记录 `grpc.wire` 与 `grpc.handler` span。
+ */
+class mirage_rpc_trace_server_interceptor final : public grpc::experimental::Interceptor {
+public:
+    void Intercept(grpc::experimental::InterceptorBatchMethods* methods) override {
+        using hook = grpc::experimental::InterceptionHookPoints;
+        auto& tracer = mirage_rpc_tracer::instance();
+
+        if (methods->QueryInterceptionHookPoint(hook::POST_RECV_INITIAL_METADATA)) {
+            const auto now = mirage_rpc_tracer::now_ns();
+            const auto* metadata = methods->GetRecvInitialMetadata();
+            const auto id = metadata->find(mirage_rpc_trace_id_key);
+            const auto send = metadata->find(mirage_rpc_trace_send_key);
+            if (id != metadata->end() && send != metadata->end()) {
+                trace_id_ = std::strtoull(std::string(id->second.data(), id->second.size()).c_str(), nullptr, 10);
+                const auto send_ns = std::strtoll(std::string(send->second.data(), send->second.size()).c_str(), nullptr, 10);
+                if (trace_id_ != 0 && send_ns != 0) {
+                    tracer.record("grpc.wire", trace_id_, send_ns, now);
+                }
+                handler_start_ns_ = now;
+            }
+        }
+        if (methods->QueryInterceptionHookPoint(hook::PRE_SEND_STATUS) && trace_id_ != 0) {
+            tracer.record("grpc.handler", trace_id_, handler_start_ns_, mirage_rpc_tracer::now_ns());
+        }
+        methods->Proceed();
+    }
+
+private:
+    uint64_t trace_id_ = 0;
+    int64_t handler_start_ns_ = 0;
+};
+
+class mirage_rpc_trace_server_interceptor_factory final
+    : public grpc::experimental::ServerInterceptorFactoryInterface {
+public:
+    grpc::experimental::Interceptor* CreateServerInterceptor(grpc::experimental::ServerRpcInfo*) override {
+        return new mirage_rpc_trace_server_interceptor();
+    }
+};
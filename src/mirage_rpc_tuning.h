@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 引入第三方库头文件
+#include "zmq.hpp"
+
+/**
+ * @file mirage_rpc_tuning.h
+ * @brief 定义了 ZMQ socket 与上下文的调优配置。
+ *
+ * 服务器和客户端的配置中都包含一个 `mirage_rpc_zmq_tuning`，默认值不修改任何 ZMQ/内核默认行为。
+ * 常见场景可以直接使用预设：`throughput()`、`latency()` 与 `memory()`。
+ */
+
+/**
+ * @brief ZMQ socket 与上下文的调优配置。
+ *
+ * 取值为 -1 的选项表示保持 ZMQ (以及操作系统) 的默认值，不会被设置。
+ */
+struct mirage_rpc_zmq_tuning {
+    // --- 内核 socket 缓冲区 ---
+    int sndbuf = -1;                 ///< SO_SNDBUF (字节)。
+    int rcvbuf = -1;                 ///< SO_RCVBUF (字节)。
+
+    // --- TCP keepalive ---
+    int tcp_keepalive = -1;          ///< 是否启用 TCP keepalive：-1 默认，0 关闭，1 启用。
+    int tcp_keepalive_idle = -1;     ///< 空闲多久后开始探测 (秒)。
+    int tcp_keepalive_intvl = -1;    ///< 探测间隔 (秒)。
+    int tcp_keepalive_cnt = -1;      ///< 判定断开前的探测次数。
+
+    // --- 消息队列 ---
+    int sndhwm = -1;                 ///< 发送方向高水位线，-1 表示使用配置中的默认值。
+    int rcvhwm = -1;                 ///< 接收方向高水位线，-1 表示使用配置中的默认值。
+    bool immediate = false;          ///< ZMQ_IMMEDIATE：只向已完成连接的对端排队消息。
+    int64_t max_msg_size = -1;       ///< ZMQ_MAXMSGSIZE：允许接收的最大消息大小 (字节)。
+    int tos = -1;                    ///< ZMQ_TOS：IP 服务类型 / DSCP (0-255)。
+
+    // --- 上下文 (I/O 线程) ---
+    std::vector<int> io_thread_cpus; ///< ZMQ I/O 线程绑定的 CPU 列表 (ZMQ_THREAD_AFFINITY_CPU_ADD，libzmq DRAFT API)。
+    int blocky = -1;                 ///< ZMQ_BLOCKY：上下文关闭时是否等待 linger，-1 默认，0 否，1 是。
+
+    // --- 预设 (Presets) ---
+
+    /** @brief 高吞吐：大内核缓冲区与深队列，适合批量数据传输。*/
+    static mirage_rpc_zmq_tuning throughput() {
+        mirage_rpc_zmq_tuning tuning;
+        tuning.sndbuf = 4 * 1024 * 1024;
+        tuning.rcvbuf = 4 * 1024 * 1024;
+        tuning.sndhwm = 100000;
+        tuning.rcvhwm = 100000;
+        tuning.tcp_keepalive = 1;
+        return tuning;
+    }
+
+    /**
+     * @brief 低延迟：不向未连接的对端排队，标记 DSCP EF，并通过 keepalive 尽快发现断开的连接。
+     * @details 不修改高水位线 (沿用配置中的 `zmq_hwm`)：ZMQ 默认值即为 1000，浅队列只在积压时限制排队延迟，
+     * 代价是 PUB 丢弃或 PUSH 阻塞，应由调用者按业务决定。
+     */
+    static mirage_rpc_zmq_tuning latency() {
+        mirage_rpc_zmq_tuning tuning;
+        tuning.immediate = true;
+        tuning.tos = 0xB8; // DSCP EF (Expedited Forwarding)
+        tuning.tcp_keepalive = 1;
+        tuning.tcp_keepalive_idle = 30;
+        tuning.tcp_keepalive_intvl = 5;
+        tuning.tcp_keepalive_cnt = 3;
+        return tuning;
+    }
+
+    /** @brief 低内存：小缓冲区与浅队列，并限制单条消息大小。*/
+    static mirage_rpc_zmq_tuning memory() {
+        mirage_rpc_zmq_tuning tuning;
+        tuning.sndbuf = 64 * 1024;
+        tuning.rcvbuf = 64 * 1024;
+        tuning.sndhwm = 100;
+        tuning.rcvhwm = 100;
+        tuning.immediate = true;
+        tuning.max_msg_size = 1024 * 1024;
+        return tuning;
+    }
+
+    /**
+     * @brief 根据名称获取预设。
+     * @param name "throughput"、"latency"、"memory" 或 "default"。
+     * @throws std::invalid_argument 如果名称未知。
+     */
+    static mirage_rpc_zmq_tuning preset(const std::string& name) {
+        if (name == "throughput") return throughput();
+        if (name == "latency") return latency();
+        if (name == "memory") return memory();
+        if (name == "default") return mirage_rpc_zmq_tuning{};
+        throw std::invalid_argument("未知的 ZMQ 调优预设: " + name);
+    }
+
+    // --- 校验与应用 ---
+
+    /**
+     * @brief 验证配置的有效性。
+     * @throws std::invalid_argument 如果任何取值超出范围，或设置了当前 libzmq 不支持的选项。
+     */
+    void validate() const {
+        if (sndbuf < -1 || rcvbuf < -1) {
+            throw std::invalid_argument("SO_SNDBUF/SO_RCVBUF 必须为 -1 或非负数");
+        }
+        if (tcp_keepalive < -1 || tcp_keepalive > 1 || blocky < -1 || blocky > 1) {
+            throw std::invalid_argument("tcp_keepalive 与 blocky 只能为 -1、0 或 1");
+        }
+        if (tcp_keepalive_idle < -1 || tcp_keepalive_intvl < -1 || tcp_keepalive_cnt < -1) {
+            throw std::invalid_argument("TCP keepalive 参数必须为 -1 或非负数");
+        }
+        if (sndhwm < -1 || rcvhwm < -1) {
+            throw std::invalid_argument("高水位线必须为 -1 或非负数");
+        }
+        if (max_msg_size < -1) {
+            throw std::invalid_argument("ZMQ_MAXMSGSIZE 必须为 -1 或非负数");
+        }
+        if (tos < -1 || tos > 255) {
+            throw std::invalid_argument("ZMQ_TOS 必须在 0-255 之间");
+        }
+        for (int cpu : io_thread_cpus) {
+            if (cpu < 0) {
+                throw std::invalid_argument("I/O 线程 CPU 编号不能为负数");
+            }
+        }
+#ifndef ZMQ_THREAD_AFFINITY_CPU_ADD
+        // 该选项只在以 DRAFT API 构建的 libzmq 中可用，不能静默忽略
+        if (!io_thread_cpus.empty()) {
+            throw std::invalid_argument("当前 libzmq 未启用 DRAFT API，不支持 ZMQ_THREAD_AFFINITY_CPU_ADD (io_thread_cpus)");
+        }
+#endif
+    }
+
+    /**
+     * @brief 将上下文级选项应用到 ZMQ 上下文。
+     * @details 必须在创建第一个 socket 之前调用，I/O 线程在那时才会启动。应先调用 `validate()`，
+     * 它会拒绝当前 libzmq 不支持的选项。
+     * @throws zmq::error_t 如果 ZMQ 拒绝了某个选项。
+     */
+    void apply(zmq::context_t& context) const {
+#ifdef ZMQ_THREAD_AFFINITY_CPU_ADD
+        for (int cpu : io_thread_cpus) {
+            set_context_option(context, ZMQ_THREAD_AFFINITY_CPU_ADD, cpu);
+        }
+#endif
+#ifdef ZMQ_BLOCKY
+        if (blocky >= 0) {
+            set_context_option(context, ZMQ_BLOCKY, blocky);
+        }
+#endif
+    }
+
+    /**
+     * @brief 将 socket 级选项应用到 ZMQ socket。
+     * @details 必须在 bind/connect 之前调用。
+     * @param socket 目标 socket。
+     * @param default_hwm 当 sndhwm/rcvhwm 为 -1 时使用的高水位线，-1 表示保持 ZMQ 默认值。
+     * @throws zmq::error_t 如果 ZMQ 拒绝了某个选项。
+     */
+    void apply(zmq::socket_t& socket, int default_hwm = -1) const {
+        const int send_hwm = sndhwm >= 0 ? sndhwm : default_hwm;
+        const int recv_hwm = rcvhwm >= 0 ? rcvhwm : default_hwm;
+        if (send_hwm >= 0) socket.set(zmq::sockopt::sndhwm, send_hwm);
+        if (recv_hwm >= 0) socket.set(zmq::sockopt::rcvhwm, recv_hwm);
+
+        if (sndbuf >= 0) socket.set(zmq::sockopt::sndbuf, sndbuf);
+        if (rcvbuf >= 0) socket.set(zmq::sockopt::rcvbuf, rcvbuf);
+
+        if (tcp_keepalive >= 0) socket.set(zmq::sockopt::tcp_keepalive, tcp_keepalive);
+        if (tcp_keepalive_idle >= 0) socket.set(zmq::sockopt::tcp_keepalive_idle, tcp_keepalive_idle);
+        if (tcp_keepalive_intvl >= 0) socket.set(zmq::sockopt::tcp_keepalive_intvl, tcp_keepalive_intvl);
+        if (tcp_keepalive_cnt >= 0) socket.set(zmq::sockopt::tcp_keepalive_cnt, tcp_keepalive_cnt);
+
+        if (immediate) socket.set(zmq::sockopt::immediate, 1);
+        if (max_msg_size >= 0) socket.set(zmq::sockopt::maxmsgsize, max_msg_size);
+        if (tos >= 0) socket.set(zmq::sockopt::tos, tos);
+    }
+
+private:
+    static void set_context_option(zmq::context_t& context, int option, int value) {
+        if (zmq_ctx_set(context.handle(), option, value) != 0) {
+            throw zmq::error_t();
+        }
+    }
+};
@@ -0,0 +1,870 @@
+//
+// mirage_rpc_stress: 数据面的长时间压力测试与故障注入工具。
+//
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "grpcpp/generic/generic_stub.h"
+#include "mirage_rpc_client.h"
+#include "mirage_rpc_server.h"
+
+/**
+ * @file mirage_rpc_stress.cpp
+ * @brief 在回环地址上运行多生产者、多消费者的服务器/客户端拓扑，并注入故障。
+ *
+ * 服务器以 PUSH 模式发送，多个客户端以 PULL 模式接收。每条消息携带生产者编号、序列号与纪元 (epoch)，
+ * 消费者据此检测丢失、重复与乱序。可注入的故障：
+ * - slow:    消费者的处理函数随机变慢；
+ * - restart: 消费者突然断开并重新连接，或者移动仍在连接中的消费者对象后重新连接 (仍有消息未收到的纪元允许丢失)；
+ * - hwm:     以很小的高水位线重启服务器，并让生产者突发发送，使发送缓冲区饱和 (EAGAIN)；
+ *            下一次 hwm 故障以正常的高水位线重启，恢复正常发送；
+ * - cycle:   服务器随机以 stop(timeout)、stop() 或直接移动运行中的服务器对象停止，移动后重新 start()。
+ *
+ * 运行期间探测线程持续通过每个消费者的 gRPC channel 发起调用，检查服务器重启后 channel 能否恢复。
+ * `--grpc-in-process` 让消费者使用进程内 channel；进程内 channel 不跟随服务器重启，且不能在服务器停止后使用，
+ * 因此每次 cycle 之前断开、之后重新连接消费者。
+ *
+ * 结束时输出吞吐稳定性、内存增长与消息丢失情况，全部检查通过时返回 0，否则返回 1。
+ * `--tuning` 为服务器与客户端应用同一个 ZMQ 调优预设 (见 mirage_rpc_tuning.h)，报告中记录所用的预设，
+ * 以相同的种子分别运行各预设即可比较它们的吞吐、延迟与内存。
+ *
+ * @example
+ *   mirage_rpc_stress --duration 600 --producers 4 --consumers 3 --faults slow,restart,hwm,cycle --report stress.json
+ */
+
+namespace {
+
+// --- 选项 (Options) ---
+
+struct stress_options {
+    int duration_s = 60;               ///< 运行时长 (秒)。
+    int producers = 4;                 ///< 生产者线程数。
+    int consumers = 3;                 ///< 消费者 (客户端) 数量。
+    size_t payload_size = 256;         ///< 消息大小 (字节)，不小于消息头。
+    std::string transport = "tcp";     ///< tcp、ipc 或 inproc。
+    std::string tuning = "default";    ///< ZMQ 调优预设：default、throughput、latency 或 memory。
+    int grpc_port = 50151;
+    int zmq_port = 5655;
+    bool grpc_in_process = false;      ///< 消费者是否使用进程内 gRPC channel。
+    bool fault_slow = false;
+    bool fault_restart = false;
+    bool fault_hwm = false;
+    bool fault_cycle = false;
+    int fault_interval_s = 5;          ///< 两次故障注入之间的平均间隔 (秒)。
+    double max_loss_ratio = 0;         ///< 非故障纪元允许的最大丢失比例。
+    double max_rss_growth_mb = 64;     ///< 允许的最大内存增长 (MB)。
+    int max_stall_s = 5;               ///< 允许的最长连续零吞吐时间 (秒)。
+    std::string report_path;           ///< JSON 报告输出路径，为空则只输出到日志。
+    uint32_t seed = 0;                 ///< 随机种子，0 表示使用当前时间。
+};
+
+void print_usage() {
+    std::printf(
+        "用法: mirage_rpc_stress [选项]\n"
+        "  --duration <秒>          运行时长 (默认 60)\n"
+        "  --producers <n>          生产者线程数 (默认 4)\n"
+        "  --consumers <n>          消费者数量 (默认 3)\n"
+        "  --payload <字节>         消息大小 (默认 256)\n"
+        "  --transport <tcp|ipc|inproc>\n"
+        "  --tuning <预设>          ZMQ 调优预设: default、throughput、latency、memory (默认 default)\n"
+        "  --grpc-port <端口> / --zmq-port <端口>\n"
+        "  --grpc-in-process        消费者使用进程内 gRPC channel (每次 cycle 前后断开并重新连接)\n"
+        "  --faults <列表>          逗号分隔: slow,restart,hwm,cycle 或 all\n"
+        "  --fault-interval <秒>    故障注入的平均间隔 (默认 5)\n"
+        "  --max-loss <比例>        非故障纪元允许的丢失比例 (默认 0)\n"
+        "  --max-rss-growth <MB>    允许的内存增长 (默认 64)\n"
+        "  --max-stall <秒>         允许的最长连续零吞吐时间 (默认 5)\n"
+        "  --report <路径>          输出 JSON 报告\n"
+        "  --seed <n>               随机种子\n");
+}
+
+stress_options parse_options(int argc, char** argv) {
+    stress_options options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("选项 " + arg + " 缺少参数");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--duration") options.duration_s = std::stoi(value());
+        else if (arg == "--producers") options.producers = std::stoi(value());
+        else if (arg == "--consumers") options.consumers = std::stoi(value());
+        else if (arg == "--payload") options.payload_size = std::stoul(value());
+        else if (arg == "--transport") options.transport = value();
+        else if (arg == "--tuning") options.tuning = value();
+        else if (arg == "--grpc-port") options.grpc_port = std::stoi(value());
+        else if (arg == "--zmq-port") options.zmq_port = std::stoi(value());
+        else if (arg == "--grpc-in-process") options.grpc_in_process = true;
+        else if (arg == "--fault-interval") options.fault_interval_s = std::stoi(value());
+        else if (arg == "--max-loss") options.max_loss_ratio = std::stod(value());
+        else if (arg == "--max-rss-growth") options.max_rss_growth_mb = std::stod(value());
+        else if (arg == "--max-stall") options.max_stall_s = std::stoi(value());
+        else if (arg == "--report") options.report_path = value();
+        else if (arg == "--seed") options.seed = static_cast<uint32_t>(std::stoul(value()));
+        else if (arg == "--faults") {
+            std::stringstream list(value());
+            std::string fault;
+            while (std::getline(list, fault, ',')) {
+                const bool all = fault == "all";
+                if (all || fault == "slow") options.fault_slow = true;
+                if (all || fault == "restart") options.fault_restart = true;
+                if (all || fault == "hwm") options.fault_hwm = true;
+                if (all || fault == "cycle") options.fault_cycle = true;
+                if (!all && fault != "slow" && fault != "restart" && fault != "hwm" && fault != "cycle") {
+                    throw std::invalid_argument("未知的故障类型: " + fault);
+                }
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            std::exit(0);
+        } else {
+            throw std::invalid_argument("未知的选项: " + arg);
+        }
+    }
+
+    if (options.duration_s <= 0 || options.producers <= 0 || options.consumers <= 0 || options.fault_interval_s <= 0) {
+        throw std::invalid_argument("时长、生产者数、消费者数与故障间隔必须大于 0");
+    }
+    if (options.transport != "tcp" && options.transport != "ipc" && options.transport != "inproc") {
+        throw std::invalid_argument("未知的传输方式: " + options.transport);
+    }
+    mirage_rpc_zmq_tuning::preset(options.tuning); // 未知的预设抛出 std::invalid_argument
+    if (options.seed == 0) {
+        options.seed = static_cast<uint32_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+    return options;
+}
+
+// --- 消息与统计 (Messages & Statistics) ---
+
+/** @brief 每条压力测试消息的头部，其后填充至 payload_size。*/
+struct stress_header {
+    uint32_t producer;
+    uint32_t epoch;
+    uint64_t seq;
+    int64_t send_ns;
+};
+
+constexpr size_t max_epochs = 4096;
+
+int64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/** @brief 当前进程的常驻内存 (字节)。*/
+size_t current_rss_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * @brief 记录每个生产者已收到的序列号，用于检测重复。
+ * @details 每个生产者维护一个滑动窗口：`base` 之前的序列号都已收到，窗口中记录之后的收到情况。
+ * 窗口超过 `max_window` 时放弃最早的空洞 (丢失由纪元计数统计)，使内存占用有界。
+ */
+class sequence_tracker {
+public:
+    static constexpr size_t max_window = size_t{1} << 22;
+
+    explicit sequence_tracker(int producers) : producers_(static_cast<size_t>(producers)) {}
+
+    /** @brief 记录一条消息。@returns 如果是重复消息，则返回 false。*/
+    bool record(const stress_header& header) {
+        auto& producer = producers_.at(header.producer);
+        std::lock_guard<std::mutex> lock(producer.mutex);
+        if (header.seq < producer.base) {
+            return false;
+        }
+        const size_t offset = static_cast<size_t>(header.seq - producer.base);
+        if (offset >= producer.window.size()) {
+            producer.window.resize(offset + 1, 0);
+        }
+        if (producer.window[offset]) {
+            return false;
+        }
+        producer.window[offset] = 1;
+
+        while (!producer.window.empty() && (producer.window.front() || producer.window.size() > max_window)) {
+            producer.window.pop_front();
+            ++producer.base;
+        }
+        return true;
+    }
+
+private:
+    struct producer_state {
+        std::mutex mutex;
+        uint64_t base = 0;
+        std::deque<uint8_t> window;
+    };
+    std::vector<producer_state> producers_;
+};
+
+/** @brief 以 2 的幂为桶的延迟直方图 (纳秒)。*/
+class latency_histogram {
+public:
+    void record(int64_t ns) {
+        size_t bucket = 0;
+        while (bucket + 1 < buckets_.size() && (int64_t{1} << (bucket + 1)) <= ns) {
+            ++bucket;
+        }
+        buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** @brief 估算分位数 (返回所在桶的上界，单位微秒)。*/
+    double percentile_us(double p) const {
+        uint64_t total = 0;
+        for (const auto& bucket : buckets_) {
+            total += bucket.load(std::memory_order_relaxed);
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const auto target = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                return static_cast<double>(int64_t{1} << (i + 1)) / 1000.0;
+            }
+        }
+        return 0;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, 48> buckets_{};
+};
+
+// --- 压力测试 (Harness) ---
+
+class stress_harness {
+public:
+    explicit stress_harness(stress_options options)
+        : options_(std::move(options)),
+          rng_(options_.seed),
+          tracker_(options_.producers),
+          last_seq_(static_cast<size_t>(options_.consumers) * static_cast<size_t>(options_.producers)),
+          probe_ok_ns_(static_cast<size_t>(options_.consumers)) {}
+
+    /** @brief 运行压力测试。@returns 是否全部检查通过。*/
+    bool run() {
+        spdlog::info("压力测试开始: 时长 {}s, 生产者 {}, 消费者 {}, 传输 {}, 调优 {}, gRPC 进程内 {}, 种子 {}",
+                     options_.duration_s, options_.producers, options_.consumers, options_.transport,
+                     options_.tuning, options_.grpc_in_process, options_.seed);
+
+        server_ = std::make_unique<mirage_rpc_server>();
+        server_->start(make_server_config()).get();
+        for (int i = 0; i < options_.consumers; ++i) {
+            consumers_.push_back(std::make_unique<mirage_rpc_client>());
+            consumers_.back()->connect(make_client_config(i));
+        }
+
+        probe_resume_ns_.store(steady_ns());
+        for (auto& ok : probe_ok_ns_) {
+            ok.store(steady_ns());
+        }
+
+        std::vector<std::thread> producers;
+        for (int i = 0; i < options_.producers; ++i) {
+            producers.emplace_back(&stress_harness::produce, this, static_cast<uint32_t>(i));
+        }
+        std::thread prober(&stress_harness::probe_grpc, this);
+
+        // 预热后记录基准内存
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        rss_baseline_ = current_rss_bytes();
+
+        monitor();
+
+        producing_.store(false);
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        prober.join();
+        drain();
+
+        for (auto& consumer : consumers_) {
+            consumer->disconnect();
+        }
+        server_->stop(std::chrono::seconds(5));
+        return report();
+    }
+
+private:
+    std::string zmq_addr() const {
+        if (options_.transport == "inproc") {
+            return "inproc://mirage-stress";
+        }
+        if (options_.transport == "ipc") {
+            return "ipc:///tmp/mirage-stress.sock";
+        }
+        return "tcp://127.0.0.1:" + std::to_string(options_.zmq_port);
+    }
+
+    /** @brief 服务器配置。hwm 故障期间使用很小的发送高水位线，覆盖调优预设中的 sndhwm。*/
+    mirage_rpc_config make_server_config() const {
+        mirage_rpc_config config;
+        config.set_grpc_addr("127.0.0.1", options_.grpc_port);
+        config.zmq_addr = zmq_addr();
+        config.zmq_socket_type = zmq::socket_type::push;
+        config.zmq_tuning = mirage_rpc_zmq_tuning::preset(options_.tuning);
+        config.zmq_hwm = 10000;
+        if (saturated_.load()) {
+            config.zmq_hwm = 64;
+            config.zmq_tuning.sndhwm = 64;
+        }
+        config.zmq_send_queue_capacity = 50000;
+        config.zmq_send_lanes = {{"priority", 10000, 0, 0, 256 * 1024}};
+        config.zmq_bind_timeout_ms = 5000;
+        config.grpc_stream_bridge = true; // 保证 gRPC 服务器有注册的服务
+        return config;
+    }
+
+    mirage_rpc_client_config make_client_config(int index) {
+        mirage_rpc_client_config config;
+        config.set_grpc_addr("127.0.0.1", options_.grpc_port);
+        config.zmq_addr = zmq_addr();
+        config.zmq_socket_type = zmq::socket_type::pull;
+        config.zmq_tuning = mirage_rpc_zmq_tuning::preset(options_.tuning);
+        config.zmq_rcv_timeout_ms = 100;
+        config.zmq_linger_ms = 0;
+        config.grpc_timeout_ms = 5000;
+        config.grpc_prefer_in_process = options_.grpc_in_process;
+        config.zmq_message_handler = [this, index](const zmq::message_t& message) { consume(index, message); };
+        return config;
+    }
+
+    /** @brief 生产者线程：持续发送带序列号的消息，队列已满或服务器重启时退避。*/
+    void produce(uint32_t producer) {
+        std::vector<char> buffer(std::max(options_.payload_size, sizeof(stress_header)), 'x');
+        uint64_t seq = 0;
+        std::mt19937 rng(options_.seed + producer);
+        while (producing_.load()) {
+            stress_header header{producer, epoch_.load(), seq, steady_ns()};
+            std::memcpy(buffer.data(), &header, sizeof(header));
+            bool accepted = false;
+            {
+                // 持有共享锁期间服务器对象不会被替换，但可能正在 stop/start
+                std::shared_lock<std::shared_mutex> lock(server_mutex_);
+                try {
+                    // 生产者 0 使用独立的优先通道，验证 DRR 调度下其他生产者无法挤占它
+                    const auto lane = producer == 0 ? server_->zmq_lane("priority") : mirage_rpc_server::default_lane;
+                    accepted = server_->zmq_try_send(lane, buffer.data(), buffer.size());
+                } catch (const std::exception&) {
+                    rejected_down_.fetch_add(1, std::memory_order_relaxed); // 服务器正在重启
+                }
+            }
+
+            if (accepted) {
+                accepted_[header.epoch % max_epochs].fetch_add(1, std::memory_order_relaxed);
+                accepted_total_.fetch_add(1, std::memory_order_relaxed);
+                ++seq;
+                if (!saturated_.load(std::memory_order_relaxed) && (seq & 0xff) == 0) {
+                    std::this_thread::yield();
+                }
+            } else {
+                backpressure_.fetch_add(1, std::memory_order_relaxed);
+                std::this_thread::sleep_for(std::chrono::microseconds(100 + rng() % 400));
+            }
+        }
+    }
+
+    /** @brief 消费者的消息处理函数。*/
+    void consume(int consumer, const zmq::message_t& message) {
+        if (message.size() < sizeof(stress_header)) {
+            malformed_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        stress_header header;
+        std::memcpy(&header, message.data(), sizeof(header));
+        if (header.producer >= static_cast<uint32_t>(options_.producers)) {
+            malformed_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        latency_.record(steady_ns() - header.send_ns);
+
+        if (!tracker_.record(header)) {
+            duplicates_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        received_[header.epoch % max_epochs].fetch_add(1, std::memory_order_relaxed);
+        received_total_.fetch_add(1, std::memory_order_relaxed);
+
+        // 同一条 ZMQ 管道上，同一生产者的消息必须保持顺序
+        {
+            std::lock_guard<std::mutex> lock(order_mutex_);
+            auto& last = last_seq_[static_cast<size_t>(consumer) * options_.producers + header.producer];
+            if (last.valid && header.seq <= last.seq && header.epoch == last.epoch) {
+                out_of_order_.fetch_add(1, std::memory_order_relaxed);
+            }
+            last = {true, header.epoch, header.seq};
+        }
+
+        if (options_.fault_slow && slow_.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200 + (header.seq % 5) * 200));
+        }
+    }
+
+    /**
+     * @brief 探测线程：持续通过每个消费者的 gRPC channel 发起一元调用。
+     * @details 调用一个未注册的方法，服务器 (流式桥接) 返回 UNIMPLEMENTED 即说明 channel 可达。
+     * 探测期间持有 consumers_mutex_，服务器重启期间暂停探测 (进程内 channel 不能在服务器停止后使用)。
+     * 记录每个消费者从最近一次成功 (或重启完成) 起最长的不可达时间。
+     */
+    void probe_grpc() {
+        grpc::CompletionQueue cq;
+        while (producing_.load()) {
+            for (size_t i = 0; i < probe_ok_ns_.size() && producing_.load(); ++i) {
+                std::unique_lock<std::mutex> lock(consumers_mutex_);
+                if (cycling_.load()) {
+                    continue;
+                }
+                std::shared_ptr<grpc::Channel> channel;
+                try {
+                    channel = consumers_[i]->get_grpc_channel();
+                } catch (const std::exception&) {
+                    continue; // 消费者正在重新连接
+                }
+                const bool ok = probe_once(channel, cq);
+                lock.unlock();
+
+                grpc_probes_.fetch_add(1, std::memory_order_relaxed);
+                const int64_t now = steady_ns();
+                if (ok) {
+                    probe_ok_ns_[i].store(now);
+                } else {
+                    grpc_probe_failures_.fetch_add(1, std::memory_order_relaxed);
+                    if (!cycling_.load()) {
+                        const int64_t since = std::max(probe_ok_ns_[i].load(), probe_resume_ns_.load());
+                        const int64_t outage_ms = (now - since) / 1000000;
+                        int64_t current = grpc_max_outage_ms_.load();
+                        while (outage_ms > current && !grpc_max_outage_ms_.compare_exchange_weak(current, outage_ms)) {
+                        }
+                    }
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        cq.Shutdown();
+        void* tag;
+        bool ok;
+        while (cq.Next(&tag, &ok)) {
+        }
+    }
+
+    /** @brief 发起一次探测调用。@returns 服务器是否处理了该调用。*/
+    static bool probe_once(const std::shared_ptr<grpc::Channel>& channel, grpc::CompletionQueue& cq) {
+        grpc::GenericStub stub(channel);
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(500));
+        grpc::Slice empty;
+        grpc::ByteBuffer request(&empty, 1);
+        grpc::ByteBuffer response;
+        grpc::Status status;
+        auto call = stub.PrepareUnaryCall(&context, "/mirage.stress.Probe/Ping", request, &cq);
+        call->StartCall();
+        call->Finish(&response, &status, call.get());
+        void* tag = nullptr;
+        bool ok = false;
+        while (cq.Next(&tag, &ok) && tag != call.get()) {
+        }
+        return status.error_code() == grpc::StatusCode::UNIMPLEMENTED;
+    }
+
+    /** @brief 主线程：每秒采样吞吐与内存，并按间隔注入故障。*/
+    void monitor() {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::seconds(options_.duration_s);
+        auto next_fault = std::chrono::steady_clock::now() + next_fault_delay();
+        uint64_t last_received = received_total_.load();
+        int stall = 0;
+
+        while (std::chrono::steady_clock::now() < end) {
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            const uint64_t received = received_total_.load();
+            samples_.push_back(static_cast<double>(received - last_received));
+            last_received = received;
+
+            stall = received == 0 || samples_.back() > 0 ? 0 : stall + 1;
+            max_stall_ = std::max(max_stall_, stall);
+            rss_peak_ = std::max(rss_peak_, current_rss_bytes());
+
+            {
+                std::shared_lock<std::shared_mutex> lock(server_mutex_);
+                if (!server_->is_running()) {
+                    failures_.push_back("服务器在未被停止的情况下退出运行 (线程异常退出)");
+                    return;
+                }
+            }
+
+            if (std::chrono::steady_clock::now() >= next_fault) {
+                inject_fault();
+                next_fault = std::chrono::steady_clock::now() + next_fault_delay();
+            }
+        }
+    }
+
+    std::chrono::milliseconds next_fault_delay() {
+        std::uniform_int_distribution<int> dist(options_.fault_interval_s * 500, options_.fault_interval_s * 1500);
+        return std::chrono::milliseconds(dist(rng_));
+    }
+
+    /** @brief 随机选择一种已启用的故障并注入。*/
+    void inject_fault() {
+        std::vector<int> enabled;
+        if (options_.fault_slow) enabled.push_back(0);
+        if (options_.fault_restart) enabled.push_back(1);
+        if (options_.fault_cycle) enabled.push_back(2);
+        if (options_.fault_hwm) enabled.push_back(3);
+        if (enabled.empty()) {
+            return;
+        }
+
+        switch (enabled[rng_() % enabled.size()]) {
+            case 0:
+                slow_.store(!slow_.load());
+                spdlog::info("[故障] 消费者处理函数{}", slow_.load() ? "变慢" : "恢复");
+                break;
+            case 1:
+                restart_consumer(static_cast<int>(rng_() % consumers_.size()));
+                break;
+            case 2:
+                cycle_server();
+                break;
+            case 3:
+                saturated_.store(!saturated_.load());
+                spdlog::info("[故障] 以{}高水位线重启服务器", saturated_.load() ? "很小的" : "正常的");
+                cycle_server();
+                break;
+        }
+        ++faults_injected_;
+    }
+
+    /**
+     * @brief 突然断开并重新连接一个消费者，或者移动仍在连接中的消费者对象。
+     * @details 已分配到该消费者管道中的消息会随断开而丢失，因此所有仍有未收到消息的纪元都允许丢失。
+     * 移动连接中的客户端时，两端都必须处于断开状态，移动后的对象必须可以重新连接。
+     */
+    void restart_consumer(int index) {
+        const bool move = rng_() % 2 == 0;
+        spdlog::info("[故障] {}消费者 {}", move ? "移动连接中的" : "重启", index);
+        std::lock_guard<std::mutex> consumers_lock(consumers_mutex_);
+        mark_outstanding_lossy();
+        if (move) {
+            auto moved = std::make_unique<mirage_rpc_client>(std::move(*consumers_[index]));
+            if (consumers_[index]->is_connected() || moved->is_connected()) {
+                failures_.push_back("移动连接中的客户端后仍有一端处于连接状态");
+            }
+            consumers_[index] = std::move(moved);
+        } else {
+            consumers_[index]->disconnect();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        try {
+            consumers_[index]->connect(make_client_config(index));
+        } catch (const std::exception& e) {
+            failures_.push_back(std::string("消费者重新连接失败: ") + e.what());
+        }
+        advance_epoch();
+    }
+
+    /** @brief 服务器循环中停止服务器的方式。*/
+    enum class cycle_mode { graceful, immediate, move_running };
+
+    /**
+     * @brief 停止服务器，移动服务器对象后重新启动。
+     * @details 随机选择停止方式：
+     * - graceful:     stop(timeout)，在期限内清空发送队列时，已被接受的消息不允许丢失；
+     * - immediate:    stop()，丢弃发送队列；
+     * - move_running: 直接移动运行中的服务器对象，移动操作负责停止它 (同样丢弃发送队列)。
+     * 停机期间生产者继续调用发送接口 (预期被拒绝)。丢弃了消息时所有仍有未收到消息的纪元都允许丢失。
+     * 使用进程内 gRPC channel 时，服务器停止会等待 channel 释放，停止前断开所有消费者，重启后重新连接。
+     */
+    void cycle_server() {
+        const auto mode = static_cast<cycle_mode>(rng_() % 3);
+        static constexpr const char* mode_names[] = {"stop(timeout)", "stop()", "移动运行中的对象"};
+        spdlog::info("[故障] 服务器 stop/start 循环: {}", mode_names[static_cast<int>(mode)]);
+        {
+            // 等待进行中的探测结束
+            std::lock_guard<std::mutex> consumers_lock(consumers_mutex_);
+            cycling_.store(true);
+            if (options_.grpc_in_process) {
+                // 断开会丢弃消费者中尚未处理的消息
+                mark_outstanding_lossy();
+                for (auto& consumer : consumers_) {
+                    consumer->disconnect();
+                }
+            }
+        }
+        if (mode == cycle_mode::graceful) {
+            if (!server_->stop(std::chrono::seconds(2))) {
+                mark_outstanding_lossy();
+            }
+        } else if (mode == cycle_mode::immediate) {
+            server_->stop();
+            mark_outstanding_lossy();
+        }
+
+        std::unique_lock<std::shared_mutex> lock(server_mutex_);
+        if (mode == cycle_mode::move_running) {
+            mark_outstanding_lossy();
+        }
+        // 移动后的对象必须可以重新启动，移动的两端都必须处于停止状态
+        auto moved = std::make_unique<mirage_rpc_server>(std::move(*server_));
+        if (server_->is_running() || moved->is_running()) {
+            failures_.push_back("移动服务器后仍有一端处于运行状态");
+        }
+        server_ = std::move(moved);
+        advance_epoch();
+        try {
+            server_->start(make_server_config()).get();
+        } catch (const std::exception& e) {
+            failures_.push_back(std::string("服务器重启失败: ") + e.what());
+        }
+        lock.unlock();
+
+        if (options_.grpc_in_process) {
+            std::lock_guard<std::mutex> consumers_lock(consumers_mutex_);
+            for (size_t i = 0; i < consumers_.size(); ++i) {
+                consumers_[i]->connect(make_client_config(static_cast<int>(i)));
+            }
+        }
+        probe_resume_ns_.store(steady_ns());
+        cycling_.store(false);
+    }
+
+    void mark_outstanding_lossy() {
+        const uint32_t current = epoch_.load();
+        const uint32_t first = current >= max_epochs ? current - max_epochs + 1 : 0;
+        for (uint32_t e = first; e <= current; ++e) {
+            if (received_[e % max_epochs].load() < accepted_[e % max_epochs].load()) {
+                lossy_[e % max_epochs].store(true);
+            }
+        }
+    }
+
+    void advance_epoch() {
+        const uint32_t next = epoch_.load() + 1;
+        lossy_[next % max_epochs].store(false);
+        accepted_[next % max_epochs].store(0);
+        received_[next % max_epochs].store(0);
+        epoch_.store(next);
+    }
+
+    /** @brief 等待消费者收完已发送的消息。*/
+    void drain() {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (received_total_.load() < accepted_total_.load() && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    /** @brief 汇总结果、输出报告。@returns 是否全部检查通过。*/
+    bool report() {
+        uint64_t lost = 0;
+        uint64_t lost_in_faults = 0;
+        uint64_t checked = 0;
+        const uint32_t epochs = std::min<uint32_t>(epoch_.load() + 1, max_epochs);
+        for (uint32_t e = 0; e < epochs; ++e) {
+            const uint64_t sent = accepted_[e].load();
+            const uint64_t got = received_[e].load();
+            const uint64_t missing = sent > got ? sent - got : 0;
+            if (lossy_[e].load()) {
+                lost_in_faults += missing;
+            } else {
+                lost += missing;
+                checked += sent;
+            }
+        }
+
+        double mean = 0;
+        for (double sample : samples_) mean += sample;
+        mean = samples_.empty() ? 0 : mean / static_cast<double>(samples_.size());
+        double variance = 0;
+        for (double sample : samples_) variance += (sample - mean) * (sample - mean);
+        variance = samples_.empty() ? 0 : variance / static_cast<double>(samples_.size());
+        const double cv = mean > 0 ? std::sqrt(variance) / mean : 0;
+        const double min_rate = samples_.empty() ? 0 : *std::min_element(samples_.begin(), samples_.end());
+
+        const double rss_growth_mb = rss_peak_ > rss_baseline_
+            ? static_cast<double>(rss_peak_ - rss_baseline_) / (1024.0 * 1024.0) : 0;
+        const double loss_ratio = checked > 0 ? static_cast<double>(lost) / static_cast<double>(checked) : 0;
+
+        if (loss_ratio > options_.max_loss_ratio) {
+            failures_.push_back("非故障纪元丢失了 " + std::to_string(lost) + " 条消息");
+        }
+        if (duplicates_.load() > 0) {
+            failures_.push_back("收到 " + std::to_string(duplicates_.load()) + " 条重复消息");
+        }
+        if (out_of_order_.load() > 0) {
+            failures_.push_back("收到 " + std::to_string(out_of_order_.load()) + " 条乱序消息");
+        }
+        if (malformed_.load() > 0) {
+            failures_.push_back("收到 " + std::to_string(malformed_.load()) + " 条格式错误的消息");
+        }
+        if (rss_growth_mb > options_.max_rss_growth_mb) {
+            failures_.push_back("内存增长 " + std::to_string(rss_growth_mb) + " MB 超过上限");
+        }
+        if (max_stall_ > options_.max_stall_s) {
+            failures_.push_back("吞吐连续 " + std::to_string(max_stall_) + " 秒为零");
+        }
+        if (received_total_.load() == 0) {
+            failures_.push_back("没有收到任何消息");
+        }
+        if (grpc_max_outage_ms_.load() > int64_t{options_.max_stall_s} * 1000) {
+            failures_.push_back("gRPC channel 连续 " + std::to_string(grpc_max_outage_ms_.load()) + " ms 不可达");
+        }
+        if (grpc_probes_.load() == grpc_probe_failures_.load()) {
+            failures_.push_back("没有任何成功的 gRPC 调用");
+        }
+
+        const bool passed = failures_.empty();
+        spdlog::info("========== 压力测试报告 ==========");
+        spdlog::info("传输 {}, 调优预设 {}, 种子 {}", options_.transport, options_.tuning, options_.seed);
+        spdlog::info("已发送 {} 条, 已接收 {} 条, 重启期间被拒绝 {} 次, 队列已满 {} 次",
+                     accepted_total_.load(), received_total_.load(), rejected_down_.load(), backpressure_.load());
+        spdlog::info("吞吐: 平均 {:.0f} msg/s, 最低 {:.0f} msg/s, 变异系数 {:.3f}, 最长停顿 {}s", mean, min_rate, cv, max_stall_);
+        spdlog::info("延迟: p50 ≤ {:.1f}us, p99 ≤ {:.1f}us, p99.9 ≤ {:.1f}us",
+                     latency_.percentile_us(0.5), latency_.percentile_us(0.99), latency_.percentile_us(0.999));
+        spdlog::info("丢失: 非故障纪元 {} 条 (比例 {:.6f}), 故障纪元 {} 条; 重复 {}, 乱序 {}",
+                     lost, loss_ratio, lost_in_faults, duplicates_.load(), out_of_order_.load());
+        spdlog::info("内存: 基准 {:.1f} MB, 峰值 {:.1f} MB, 增长 {:.1f} MB",
+                     static_cast<double>(rss_baseline_) / (1024.0 * 1024.0),
+                     static_cast<double>(rss_peak_) / (1024.0 * 1024.0), rss_growth_mb);
+        spdlog::info("gRPC: 探测 {} 次, 失败 {} 次, 最长不可达 {} ms (进程内 channel: {})",
+                     grpc_probes_.load(), grpc_probe_failures_.load(), grpc_max_outage_ms_.load(), options_.grpc_in_process);
+        spdlog::info("故障注入 {} 次, 纪元 {} 个", faults_injected_, epoch_.load() + 1);
+        for (const auto& failure : failures_) {
+            spdlog::error("失败: {}", failure);
+        }
+        spdlog::info("结果: {}", passed ? "通过" : "失败");
+
+        if (!options_.report_path.empty()) {
+            std::ofstream out(options_.report_path);
+            out << "{\n"
+                << "  \"passed\": " << (passed ? "true" : "false") << ",\n"
+                << "  \"seed\": " << options_.seed << ",\n"
+                << "  \"duration_s\": " << options_.duration_s << ",\n"
+                << "  \"transport\": \"" << options_.transport << "\",\n"
+                << "  \"tuning\": \"" << options_.tuning << "\",\n"
+                << "  \"grpc_in_process\": " << (options_.grpc_in_process ? "true" : "false") << ",\n"
+                << "  \"accepted\": " << accepted_total_.load() << ",\n"
+                << "  \"received\": " << received_total_.load() << ",\n"
+                << "  \"lost\": " << lost << ",\n"
+                << "  \"lost_in_fault_epochs\": " << lost_in_faults << ",\n"
+                << "  \"duplicates\": " << duplicates_.load() << ",\n"
+                << "  \"out_of_order\": " << out_of_order_.load() << ",\n"
+                << "  \"throughput_mean\": " << mean << ",\n"
+                << "  \"throughput_min\": " << min_rate << ",\n"
+                << "  \"throughput_cv\": " << cv << ",\n"
+                << "  \"max_stall_s\": " << max_stall_ << ",\n"
+                << "  \"latency_p50_us\": " << latency_.percentile_us(0.5) << ",\n"
+                << "  \"latency_p99_us\": " << latency_.percentile_us(0.99) << ",\n"
+                << "  \"latency_p999_us\": " << latency_.percentile_us(0.999) << ",\n"
+                << "  \"rss_peak_mb\": " << static_cast<double>(rss_peak_) / (1024.0 * 1024.0) << ",\n"
+                << "  \"rss_growth_mb\": " << rss_growth_mb << ",\n"
+                << "  \"grpc_probes\": " << grpc_probes_.load() << ",\n"
+                << "  \"grpc_probe_failures\": " << grpc_probe_failures_.load() << ",\n"
+                << "  \"grpc_max_outage_ms\": " << grpc_max_outage_ms_.load() << ",\n"
+                << "  \"faults_injected\": " << faults_injected_ << ",\n"
+                << "  \"failures\": [";
+            for (size_t i = 0; i < failures_.size(); ++i) {
+                out << (i ? ", " : "") << "\"" << failures_[i] << "\"";
+            }
+            out << "]\n}\n";
+        }
+        return passed;
+    }
+
+    struct last_seen {
+        bool valid = false;
+        uint32_t epoch = 0;
+        uint64_t seq = 0;
+    };
+
+    stress_options options_;
+    std::mt19937 rng_;
+
+    // 拓扑
+    std::shared_mutex server_mutex_; ///< 保护 server_ 对象的替换，生产者发送时持有共享锁。
+    std::unique_ptr<mirage_rpc_server> server_;
+    std::mutex consumers_mutex_;     ///< 保护消费者的重新连接，探测线程获取 channel 时持有。
+    std::vector<std::unique_ptr<mirage_rpc_client>> consumers_;
+
+    // 生产与故障状态
+    std::atomic<bool> producing_{true};
+    std::atomic<bool> slow_{false};
+    std::atomic<bool> saturated_{false};   ///< hwm 故障：服务器以很小的高水位线运行，生产者突发发送。
+    std::atomic<bool> cycling_{false};     ///< 服务器正在 stop/start，暂停 gRPC 探测。
+    std::atomic<uint32_t> epoch_{0};
+    std::array<std::atomic<bool>, max_epochs> lossy_{};
+    std::array<std::atomic<uint64_t>, max_epochs> accepted_{};
+    std::array<std::atomic<uint64_t>, max_epochs> received_{};
+    int faults_injected_ = 0;
+
+    // 计数
+    std::atomic<uint64_t> accepted_total_{0};
+    std::atomic<uint64_t> received_total_{0};
+    std::atomic<uint64_t> rejected_down_{0};
+    std::atomic<uint64_t> backpressure_{0};
+    std::atomic<uint64_t> duplicates_{0};
+    std::atomic<uint64_t> out_of_order_{0};
+    std::atomic<uint64_t> malformed_{0};
+    sequence_tracker tracker_;
+    latency_histogram latency_;
+    std::mutex order_mutex_;
+    std::vector<last_seen> last_seq_; ///< 每个 (消费者, 生产者) 最后收到的序列号。
+
+    // gRPC 探测
+    std::vector<std::atomic<int64_t>> probe_ok_ns_; ///< 每个消费者最近一次探测成功的时间。
+    std::atomic<int64_t> probe_resume_ns_{0};       ///< 最近一次服务器重启完成的时间。
+    std::atomic<uint64_t> grpc_probes_{0};
+    std::atomic<uint64_t> grpc_probe_failures_{0};
+    std::atomic<int64_t> grpc_max_outage_ms_{0};
+
+    // 监控
+    std::vector<double> samples_;
+    int max_stall_ = 0;
+    size_t rss_baseline_ = 0;
+    size_t rss_peak_ = 0;
+    std::vector<std::string> failures_;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    try {
+        stress_harness harness(parse_options(argc, argv));
+        return harness.run() ? 0 : 1;
+    } catch (const std::exception& e) {
+        spdlog::error("压力测试异常终止: {}", e.what());
+        print_usage();
+        return 2;
+    }
+}